@@ -0,0 +1,181 @@
+/*
+*
+*  @brief     Memory allocation
+*  @details   Pluggable allocator used for all cluster and engine memory
+*  @author    Matej Soroka
+*
+*/
+#include <stdlib.h>
+
+#include "alloc.h"
+
+/**
+*  malloc of libc
+*  @ingroup alloc
+*/
+static void *libc_malloc(size_t size, void *ctx)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+/**
+*  realloc of libc
+*  @ingroup alloc
+*/
+static void *libc_realloc(void *ptr, size_t size, void *ctx)
+{
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+/**
+*  free of libc
+*  @ingroup alloc
+*/
+static void libc_free(void *ptr, void *ctx)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+/// Allocator of libc
+static const struct allocator libc_allocator = {
+    libc_malloc, libc_realloc, libc_free, NULL
+};
+
+#ifdef TRACK_ALLOC
+
+struct alloc_stats alloc_stats;
+
+/*
+ Every block starts with header holding its size, so free knows how many
+ bytes stop being live. Counters are updated atomically, engines allocate
+ from worker threads.
+*/
+
+/// Size of header in front of block, keeps alignment of malloc
+#define ALLOC_HEADER 16
+
+/**
+*  Adds bytes to live memory and updates peak
+*  @ingroup alloc
+*  @param delta change of live bytes
+*/
+static void track_live(long long delta)
+{
+    unsigned long long live = __atomic_add_fetch(&alloc_stats.live, delta, __ATOMIC_RELAXED);
+    unsigned long long peak = __atomic_load_n(&alloc_stats.peak, __ATOMIC_RELAXED);
+
+    while (live > peak && !__atomic_compare_exchange_n(&alloc_stats.peak, &peak, live, 0,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+*  Bucket of histogram for size
+*  @ingroup alloc
+*  @param size number of bytes
+*  @return floor of log2 of size
+*/
+static int size_bucket(size_t size)
+{
+    int b = 0;
+    while (size > 1 && b < ALLOC_BUCKETS - 1)
+    {
+        size >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/**
+*  Tracking malloc
+*  @ingroup alloc
+*/
+static void *track_malloc(size_t size, void *ctx)
+{
+    (void)ctx;
+    char *p = malloc(size + ALLOC_HEADER);
+    if (p == NULL)
+        return NULL;
+
+    *(size_t *)p = size;
+    __atomic_add_fetch(&alloc_stats.mallocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_stats.bytes, size, __ATOMIC_RELAXED);
+    track_live(size);
+    return p + ALLOC_HEADER;
+}
+
+/**
+*  Tracking realloc
+*  @ingroup alloc
+*/
+static void *track_realloc(void *ptr, size_t size, void *ctx)
+{
+    if (ptr == NULL)
+        return track_malloc(size, ctx);
+
+    char *p = (char *)ptr - ALLOC_HEADER;
+    size_t old = *(size_t *)p;
+
+    if ((p = realloc(p, size + ALLOC_HEADER)) == NULL)
+        return NULL;
+
+    *(size_t *)p = size;
+    __atomic_add_fetch(&alloc_stats.reallocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_stats.bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_stats.realloc_size[size_bucket(size)], 1, __ATOMIC_RELAXED);
+    track_live((long long)size - (long long)old);
+    return p + ALLOC_HEADER;
+}
+
+/**
+*  Tracking free
+*  @ingroup alloc
+*/
+static void track_free(void *ptr, void *ctx)
+{
+    (void)ctx;
+    if (ptr == NULL)
+        return;
+
+    char *p = (char *)ptr - ALLOC_HEADER;
+    __atomic_add_fetch(&alloc_stats.frees, 1, __ATOMIC_RELAXED);
+    track_live(-(long long)*(size_t *)p);
+    free(p);
+}
+
+const struct allocator tracking_allocator = {
+    track_malloc, track_realloc, track_free, NULL
+};
+
+/// Current allocator
+static const struct allocator *current = &tracking_allocator;
+
+#else
+
+/// Current allocator
+static const struct allocator *current = &libc_allocator;
+
+#endif
+
+void set_allocator(const struct allocator *a)
+{
+    current = a ? a : &libc_allocator;
+}
+
+void *xmalloc(size_t size)
+{
+    return current->malloc(size, current->ctx);
+}
+
+void *xrealloc(void *ptr, size_t size)
+{
+    return current->realloc(ptr, size, current->ctx);
+}
+
+void xfree(void *ptr)
+{
+    current->free(ptr, current->ctx);
+}
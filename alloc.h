@@ -0,0 +1,78 @@
+/*
+*
+*  @brief     Memory allocation
+*  @details   Pluggable allocator used for all cluster and engine memory
+*  @author    Matej Soroka
+*
+*/
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+///@defgroup alloc Memory allocation
+
+/// Number of power of two buckets in histogram of realloc sizes
+#define ALLOC_BUCKETS 40
+
+/// @struct allocator
+struct allocator {
+    void *(*malloc)(size_t size, void *ctx);              ///< like malloc
+    void *(*realloc)(void *ptr, size_t size, void *ctx);  ///< like realloc
+    void (*free)(void *ptr, void *ctx);                   ///< like free
+    void *ctx;                                            ///< user data
+};
+
+/// @struct alloc_stats
+struct alloc_stats {
+    unsigned long long mallocs;       ///< number of malloc calls
+    unsigned long long reallocs;      ///< number of realloc calls
+    unsigned long long frees;         ///< number of free calls
+    unsigned long long bytes;         ///< bytes requested by malloc and realloc
+    unsigned long long live;          ///< bytes allocated now
+    unsigned long long peak;          ///< maximum of live
+    unsigned long long realloc_size[ALLOC_BUCKETS]; ///< reallocs by log2 of new size
+};
+
+/**
+*  Replaces allocator, the previous one must not own any memory in use
+*  @ingroup alloc
+*  @param a allocator, NULL for libc
+*/
+void set_allocator(const struct allocator *a);
+
+/**
+*  Allocates memory by current allocator
+*  @ingroup alloc
+*  @param size number of bytes
+*  @return pointer to memory or NULL
+*/
+void *xmalloc(size_t size);
+
+/**
+*  Reallocates memory by current allocator
+*  @ingroup alloc
+*  @param ptr pointer to memory or NULL
+*  @param size number of bytes
+*  @return pointer to memory or NULL
+*/
+void *xrealloc(void *ptr, size_t size);
+
+/**
+*  Frees memory by current allocator
+*  @ingroup alloc
+*  @param ptr pointer to memory or NULL
+*/
+void xfree(void *ptr);
+
+#ifdef TRACK_ALLOC
+
+/// Allocator counting calls and bytes, installed when built with TRACK_ALLOC
+extern const struct allocator tracking_allocator;
+
+/// Counters of tracking_allocator
+extern struct alloc_stats alloc_stats;
+
+#endif
+
+#endif
@@ -0,0 +1,239 @@
+/*
+*
+*  @brief     Batch mode
+*  @details   Clusters many input files in one process with pool of threads
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "batch.h"
+#include "cache.h"
+#include "stats.h"
+#include "numa.h"
+
+/// @struct job
+struct job {
+    char file[1024];    ///< input file
+    char out[1100];     ///< output file
+    int narr;           ///< requested number of clusters
+    int method;         ///< cluster distance method
+    int objects;        ///< number of loaded objects
+    double load;        ///< seconds spent in load_clusters
+    double cluster;     ///< seconds spent in engine
+    double write;       ///< seconds spent writing output
+    const char *error;  ///< NULL if job succeeded
+};
+
+/// State shared by workers
+struct pool {
+    struct job *jobs;                ///< all jobs
+    int count;                       ///< number of jobs
+    int next;                        ///< next job to take
+    const struct engine_opts *opts;  ///< engine and threads of jobs
+};
+
+/**
+*  Runs one job
+*  @ingroup batch
+*  @param job job
+*  @param opts engine options with workspace of worker
+*/
+static void run_job(struct job *job, struct engine_opts *opts)
+{
+    struct cluster_t *clusters;
+    double t = stats_now();
+
+    int size = load_clusters(job->file, &clusters);
+    job->load = stats_now() - t;
+    if (size == 0)
+    {
+        job->error = "load failed";
+        return;
+    }
+
+    // objects of more than two coordinates share one block of coordinates
+    float *coords = CLUSTER_OBJ(&clusters[0])[0].v;
+
+    job->objects = size;
+    if (job->narr > size)
+        job->error = "N is greater than count of clusters";
+    else if ((job->error = engine_unsupported(&CLUSTER_OBJ(&clusters[0])[0], job->method)) == NULL)
+    {
+        int engine = opts->engine;
+        opts->method = job->method;
+        opts->engine = engine_for_method(engine, job->method);
+        t = stats_now();
+        if (cache_dir)
+            size = cache_run(&clusters, size, job->narr, opts);
+        else
+            size = engine_run(clusters, size, job->narr, opts);
+        opts->engine = engine;
+        job->cluster = stats_now() - t;
+
+        // failed run leaves all loaded clusters in array, cache_run may
+        // have freed it already
+        if (size < 0)
+        {
+            job->error = "memory allocation failed";
+            size = clusters ? job->objects : 0;
+        }
+        else
+        {
+            t = stats_now();
+            FILE *f = fopen(job->out, "w");
+            if (f)
+            {
+                fprint_clusters(f, clusters, size);
+                if (fclose(f))
+                    job->error = "output write failed";
+            }
+            else
+                job->error = "output can't be opened";
+            job->write = stats_now() - t;
+        }
+    }
+
+    for (int i = 0; i < size; i++)
+        clear_cluster(&clusters[i]);
+    xfree(clusters);
+    xfree(coords);
+}
+
+/**
+*  Worker of pool, takes jobs until none is left. Engine workspace is kept
+*  for all jobs of worker.
+*  @ingroup batch
+*  @param arg pointer to struct pool
+*  @return NULL
+*/
+static void *batch_worker(void *arg)
+{
+    struct pool *pool = arg;
+    struct engine_ws ws = { NULL, 0 };
+    struct engine_opts opts = *pool->opts;
+    int pinned = numa_pin();
+    int i;
+
+    opts.ws = &ws;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count)
+        run_job(&pool->jobs[i], &opts);
+
+    engine_ws_free(&ws);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+/**
+*  Parses line of manifest
+*  @ingroup batch
+*  @param line line of manifest
+*  @param job job to fill
+*  @param method default method
+*  @return 1 for job, 0 for skipped line, -1 for invalid line
+*/
+static int parse_job(char *line, struct job *job, int method)
+{
+    char file[1024], n[32], m[32] = "", out[1024] = "";
+    char *fail;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#')
+        return 0;
+
+    if (sscanf(line, "%1023s %31s %31s %1023s", file, n, m, out) < 2)
+        return -1;
+
+    memset(job, 0, sizeof(*job));
+    strcpy(job->file, file);
+    job->narr = strtol(n, &fail, 10);
+    if (*fail || job->narr <= 0)
+        return -1;
+
+    job->method = method;
+    if (m[0] == '-' && m[1] == '-')
+    {
+        if ((job->method = method_by_name(m + 2)) < 0)
+            return -1;
+    }
+    else if (m[0])
+        strcpy(out, m);
+
+    if (out[0])
+        strcpy(job->out, out);
+    else
+        snprintf(job->out, sizeof(job->out), "%s.%d.%s.out", file, job->narr,
+                 method_names[job->method]);
+    return 1;
+}
+
+int batch_run(const char *manifest, int jobs, const struct engine_opts *opts)
+{
+    FILE *f = fopen(manifest, "r");
+    char line[4096];
+    struct pool pool = { NULL, 0, 0, opts };
+    int cap = 0, lineNumber = 0, failed = 0;
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "Manifest not found\n");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        lineNumber++;
+        if (pool.count == cap)
+        {
+            cap = cap ? 2 * cap : 64;
+            struct job *tmp = xrealloc(pool.jobs, sizeof(struct job) * cap);
+            if (tmp == NULL)
+            {
+                fprintf(stderr, "Memory allocation was not succeed\n");
+                break;
+            }
+            pool.jobs = tmp;
+        }
+
+        int r = parse_job(line, &pool.jobs[pool.count], opts->method);
+        if (r < 0)
+            fprintf(stderr, "Invalid manifest line %d\n", lineNumber);
+        pool.count += r > 0;
+        failed += r < 0;
+    }
+    fclose(f);
+
+    if (jobs > pool.count)
+        jobs = pool.count > 0 ? pool.count : 1;
+
+    double start = stats_now();
+    pthread_t tid[jobs];
+    int started[jobs];
+
+    for (int t = 1; t < jobs; t++)
+        started[t] = !pthread_create(&tid[t], NULL, batch_worker, &pool);
+    batch_worker(&pool);
+    for (int t = 1; t < jobs; t++)
+        if (started[t])
+            pthread_join(tid[t], NULL);
+
+    double total = stats_now() - start;
+
+    for (int i = 0; i < pool.count; i++)
+    {
+        struct job *j = &pool.jobs[i];
+        fprintf(stderr, "job %d: %s %d --%s -> %s: %d objects, load %.6f s, cluster %.6f s, "
+                "write %.6f s, %s\n", i, j->file, j->narr, method_names[j->method], j->out,
+                j->objects, j->load, j->cluster, j->write, j->error ? j->error : "ok");
+        failed += j->error != NULL;
+    }
+    fprintf(stderr, "batch: %d jobs, %d failed, %d workers, %.6f s\n",
+            pool.count, failed, jobs, total);
+
+    xfree(pool.jobs);
+    return failed;
+}
@@ -0,0 +1,29 @@
+/*
+*
+*  @brief     Batch mode
+*  @details   Clusters many input files in one process with pool of threads
+*  @author    Matej Soroka
+*
+*/
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "engine.h"
+
+///@defgroup batch Batch mode
+
+/**
+*  Runs jobs of manifest. Every line of manifest is one job
+*  "FILE N [METHOD] [OUTPUT]", empty lines and lines starting with # are
+*  skipped. METHOD is any method of method_by_name, --avg, --min, --max,
+*  --ward, --centroid or --median (default from opts), OUTPUT defaults to
+*  FILE.N.METHOD.out. Timing of every job is printed to stderr.
+*  @ingroup batch
+*  @param manifest name of manifest file
+*  @param jobs number of jobs running at once
+*  @param opts engine, default method and threads of every job
+*  @return number of failed jobs or -1 if manifest can't be read
+*/
+int batch_run(const char *manifest, int jobs, const struct engine_opts *opts);
+
+#endif
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Compares two result files written by bench/run.sh.
+#
+# Usage: compare.sh BASELINE CURRENT [TOLERANCE]
+#
+# Prints the ratio current/baseline for every row present in both files and
+# exits with status 1 when some ratio exceeds TOLERANCE (default 1.10).
+# Phases shorter than 1 ms in the baseline are too noisy and are skipped.
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 BASELINE CURRENT [TOLERANCE]" >&2
+    exit 2
+fi
+
+awk -F, -v tol="${3:-1.10}" '
+    FNR == 1 { next }
+    { key = $1 "," $2 "," $3 "," $4 "," $5 "," $6 }
+    NR == FNR { if ($8 == "ok") base[key] = $7; next }
+    $8 != "ok" || !(key in base) { next }
+    {
+        if (base[key] < 0.001)
+            next
+        ratio = $7 / base[key]
+        flag = ratio > tol ? "  REGRESSION" : ""
+        printf "%-48s %10.4f %10.4f %6.2fx%s\n", key, base[key], $7, ratio, flag
+        if (ratio > tol)
+            bad++
+    }
+    END { exit bad ? 1 : 0 }
+' "$1" "$2"
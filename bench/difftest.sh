@@ -0,0 +1,194 @@
+#!/bin/sh
+#
+# Differential check of engines against the reference loop. Runs every
+# engine, method, thread count and instruction set level on random datasets from bench/gen and
+# compares print_clusters output with --engine=ref byte for byte. Dataset
+# kinds dup and grid have many equal distances, so tie breaking is covered.
+#
+# Environment:
+#   ROUNDS   random datasets per kind   (default: 20)
+#   ENGINES  engines compared to ref    (default: matrix)
+#   THREADS  thread counts              (default: 1 2 4)
+#   ISAS     kernel instruction sets    (default: scalar sse2 avx2)
+#   KINDS    dataset kinds              (default: uniform gauss dup grid line)
+#   METHODS  linkage methods            (default: all methods)
+#   DIMS     numbers of coordinates     (default: 2 5 64)
+#   METRICS  distance metrics           (default: all metrics)
+#   MODES    other paths compared to ref (default: cache insert query)
+#
+# Mode cache runs every case twice with --cache in an empty directory, the
+# first run is a miss and stores merges, the second one is a cut of them.
+# Mode insert adds the first and the second half of a 2-D --min case to a
+# new --insert tree. Incremental clusters may differ at equal distances, so
+# dup and grid datasets are skipped.
+# Mode query asks --query for every object and compares each answer with
+# the cluster of ref output which contains the object.
+#
+# Engine generic supports only methods computed from centroids, check it
+# with ENGINES=generic METHODS="--ward --centroid --median". Engine nnchain
+# supports only --ward, check it with ENGINES=nnchain METHODS=--ward.
+#
+# Before random datasets, every dimension of DIMS above 2 runs four near
+# points far from the origin: object 2 is object 1 moved by 0.05, object 3
+# by 0.5 and object 4 by 3 in other coordinates. Distances computed as
+# |a|^2 + |b|^2 - 2 a.b lose them to cancellation, and ref would be wrong
+# too, so the three clusters are compared with {1, 2}, {3}, {4}.
+#
+# Exits with status 1 and prints reproducing command on first difference.
+
+set -u
+
+dir=$(dirname "$0")
+proj=${PROJ:-$dir/../proj3}
+gen=$dir/gen
+
+ROUNDS=${ROUNDS:-20}
+ENGINES=${ENGINES:-"matrix"}
+THREADS=${THREADS:-"1 2 4"}
+ISAS=${ISAS:-"scalar sse2 avx2"}
+KINDS=${KINDS:-"uniform gauss dup grid line"}
+METHODS=${METHODS:-"--avg --min --max --ward --centroid --median"}
+DIMS=${DIMS:-"2 5 64"}
+METRICS=${METRICS:-"euclidean sqeuclidean manhattan chebyshev cosine"}
+MODES=${MODES:-"cache insert query"}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+mkdir "$tmp/cache" || exit 1
+
+cases=0
+printf 'cluster 0: 1 2\ncluster 1: 3\ncluster 2: 4\n' > "$tmp/near-expected.txt"
+for dim in $DIMS; do
+    [ "$dim" -gt 2 ] || continue
+    awk -v dim="$dim" 'BEGIN {
+        print "count=4"
+        for (i = 1; i <= 4; i++) {
+            line = i
+            for (k = 0; k < dim; k++) {
+                c = 500 + (k * 37) % 500
+                if (i == 2 && k == 0) c += 0.05
+                if (i == 3 && k == 1) c += 0.5
+                if (i == 4 && k == 2) c += 3
+                line = line " " c
+            }
+            print line
+        }
+    }' > "$tmp/near.txt"
+
+    for metric in $METRICS; do
+    [ "$metric" = cosine ] && continue
+    for method in --avg --min --max; do
+    for engine in ref $ENGINES; do
+    for isa in $ISAS; do
+        "$proj" "$tmp/near.txt" 3 "$method" --metric="$metric" --engine="$engine" --isa="$isa" |
+            sed -n 's/\[[^]]*\]//g; /^cluster/p' > "$tmp/out.txt"
+        if ! cmp -s "$tmp/near-expected.txt" "$tmp/out.txt"; then
+            echo "DIFF: near points of $dim coordinates | proj3 FILE 3 $method" \
+                 "--metric=$metric --engine=$engine --isa=$isa, expected clusters {1, 2}, {3}, {4}" >&2
+            exit 1
+        fi
+        cases=$((cases + 1))
+    done
+    done
+    done
+    done
+done
+
+for dim in $DIMS; do
+for kind in $KINDS; do
+    round=1
+    while [ $round -le "$ROUNDS" ]; do
+        # size and requested cluster count derived from round
+        n=$(( (round * 37) % 150 + 2 ))
+        k=$(( (round * 13) % n + 1 ))
+        data=$tmp/$kind-$round.txt
+        "$gen" "$kind" "$n" "$round" "$dim" > "$data" || exit 1
+
+        for metric in $METRICS; do
+        for method in $METHODS; do
+            # methods computed from centroids support only 2-D Euclidean objects
+            case $dim:$metric:$method in
+                2:euclidean:*) ;;
+                *:--ward|*:--centroid|*:--median) continue ;;
+            esac
+
+            "$proj" "$data" "$k" "$method" --metric="$metric" --engine=ref > "$tmp/ref.txt" || exit 1
+
+            for engine in $ENGINES; do
+                for threads in $THREADS; do
+                    for isa in $ISAS; do
+                        "$proj" "$data" "$k" "$method" --metric="$metric" --engine="$engine" \
+                            --threads="$threads" --isa="$isa" > "$tmp/out.txt"
+                        if ! cmp -s "$tmp/ref.txt" "$tmp/out.txt"; then
+                            echo "DIFF: gen $kind $n $round $dim | proj3 FILE $k $method" \
+                                 "--metric=$metric --engine=$engine --threads=$threads --isa=$isa" >&2
+                            exit 1
+                        fi
+                        cases=$((cases + 1))
+                    done
+                done
+            done
+
+            for mode in $MODES; do
+                case $mode in
+                    cache)
+                        for hit in miss hit; do
+                            "$proj" "$data" "$k" "$method" --metric="$metric" \
+                                --cache="$tmp/cache" > "$tmp/out.txt"
+                            if ! cmp -s "$tmp/ref.txt" "$tmp/out.txt"; then
+                                echo "DIFF: gen $kind $n $round $dim | proj3 FILE $k $method" \
+                                     "--metric=$metric --cache=DIR (cache $hit)" >&2
+                                exit 1
+                            fi
+                            cases=$((cases + 1))
+                        done
+                        ;;
+                    insert)
+                        case $dim:$metric:$method:$kind in
+                            *:dup|*:grid) continue ;;
+                            2:euclidean:--min:*) ;;
+                            *) continue ;;
+                        esac
+                        half=$((n / 2))
+                        { echo "count=$half"; sed -n "2,$((half + 1))p" "$data"; } > "$tmp/first.txt"
+                        { echo "count=$((n - half))"; sed -n "$((half + 2)),\$p" "$data"; } > "$tmp/second.txt"
+                        rm -f "$tmp/tree"
+                        "$proj" "$tmp/first.txt" 1 --min --insert="$tmp/tree" > /dev/null &&
+                        "$proj" "$tmp/second.txt" "$k" --min --insert="$tmp/tree" > "$tmp/out.txt"
+                        if ! cmp -s "$tmp/ref.txt" "$tmp/out.txt"; then
+                            echo "DIFF: gen $kind $n $round $dim | proj3 FILE $k --min" \
+                                 "--insert=TREE of objects 1..$half, then $((half + 1))..$n" >&2
+                            exit 1
+                        fi
+                        cases=$((cases + 1))
+                        ;;
+                    query)
+                        ids=$(awk 'NR > 1 { print $1 }' "$data" | paste -sd, -)
+                        "$proj" "$data" "$k" "$method" --metric="$metric" --query="$ids" > "$tmp/out.txt"
+                        # members and size of cluster of every id, then one answer per id
+                        if ! awk 'NR == FNR {
+                                      if ($1 != "cluster") next
+                                      rest = $0; sub(/^[^:]*: /, "", rest)
+                                      for (i = 3; i <= NF; i++) { id = $i; sub(/\[.*/, "", id); line[id] = rest; size[id] = NF - 2; ids++ }
+                                      next
+                                  }
+                                  FNR % 2 == 1 { id = $2; sub(/:$/, "", id); ok = ok && (id in line) && !(id in seen) && $5 == size[id]; seen[id] = 1; next }
+                                  { ok = ok && $0 == line[id]; answers++ }
+                                  BEGIN { ok = 1 }
+                                  END { exit !(ok && answers == ids) }' "$tmp/ref.txt" "$tmp/out.txt"; then
+                            echo "DIFF: gen $kind $n $round $dim | proj3 FILE $k $method" \
+                                 "--metric=$metric --query=$ids" >&2
+                            exit 1
+                        fi
+                        cases=$((cases + 1))
+                        ;;
+                esac
+            done
+        done
+        done
+        round=$((round + 1))
+    done
+done
+done
+
+echo "$cases cases equal to reference" >&2
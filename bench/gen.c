@@ -0,0 +1,195 @@
+/*
+*
+*  @brief     Synthetic dataset generator for benchmarks
+*  @details   Writes objects of 2 or more dimensions in the format accepted
+*             by load_clusters
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/// Upper bound of coordinates accepted by load_clusters
+#define COORD_MAX 1000.0
+
+/// Pi, M_PI is not part of C99
+#define PI 3.14159265358979323846
+
+/// Number of blob centres for gauss dataset
+#define BLOBS 16
+
+/// Number of distinct points for dup dataset
+#define DUP_POINTS 64
+
+/// Highest number of coordinates
+#define DIM_MAX 1024
+
+/// State of the generator, seeded explicitly so datasets are reproducible
+static unsigned long long rng_state;
+
+/**
+*  Next 64-bit pseudo random number (splitmix64), independent of libc rand()
+*  @return pseudo random number
+*/
+static unsigned long long rng_next(void)
+{
+    unsigned long long z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+*  Uniform number from interval [0, 1)
+*  @return pseudo random number
+*/
+static double rng_unit(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+*  Normally distributed number (Box-Muller)
+*  @param mean mean of distribution
+*  @param sd standard deviation
+*  @return pseudo random number
+*/
+static double rng_gauss(double mean, double sd)
+{
+    double u = rng_unit(), v = rng_unit();
+    if (u < 1e-300)
+        u = 1e-300;
+    return mean + sd * sqrt(-2.0 * log(u)) * cos(2.0 * PI * v);
+}
+
+/**
+*  Clamps coordinate into interval accepted by load_clusters
+*  @param v coordinate
+*  @return clamped coordinate
+*/
+static double clamp(double v)
+{
+    if (v < 0)
+        return 0;
+    if (v > COORD_MAX)
+        return COORD_MAX;
+    return v;
+}
+
+/**
+*  Prints one object, coordinates are rounded to two decimals
+*  @param id identifier of object
+*  @param c coordinates
+*  @param dim number of coordinates
+*/
+static void emit(int id, const double *c, int dim)
+{
+    printf("%d", id);
+    for (int k = 0; k < dim; k++)
+        printf(" %.2f", clamp(c[k]));
+    putchar('\n');
+}
+
+/**
+*  Main function
+*  @param argc number of arguments
+*  @param argv KIND N [SEED [DIM]]
+*  @return zero if program is successful
+*/
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s uniform|gauss|dup|grid|line N [SEED [DIM]]\n", argv[0]);
+        return 1;
+    }
+
+    char *fail;
+    long n = strtol(argv[2], &fail, 10);
+    if (*fail || n < 1 || n > 100000000)
+    {
+        fprintf(stderr, "Invalid object count\n");
+        return 1;
+    }
+
+    rng_state = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+
+    int dim = argc > 4 ? atoi(argv[4]) : 2;
+    if (dim < 2 || dim > DIM_MAX)
+    {
+        fprintf(stderr, "Invalid dimension\n");
+        return 1;
+    }
+
+    // centres of the first two coordinates come first, so 2-D datasets
+    // don't depend on dimensions
+    static double centre[BLOBS][DIM_MAX];
+    for (int i = 0; i < BLOBS; i++)
+    {
+        centre[i][0] = 100 + rng_unit() * 800;
+        centre[i][1] = 100 + rng_unit() * 800;
+    }
+    for (int i = 0; i < BLOBS; i++)
+        for (int k = 2; k < dim; k++)
+            centre[i][k] = 100 + rng_unit() * 800;
+
+    printf("count=%ld\n", n);
+
+    double c[DIM_MAX];
+    for (long i = 0; i < n; i++)
+    {
+        int id = (int)i + 1;
+
+        // y is drawn before x, as datasets of earlier versions were
+        if (!strcmp(argv[1], "uniform"))
+        {
+            c[1] = rng_unit() * COORD_MAX;
+            c[0] = rng_unit() * COORD_MAX;
+            for (int k = 2; k < dim; k++)
+                c[k] = rng_unit() * COORD_MAX;
+        }
+        else if (!strcmp(argv[1], "gauss"))
+        {
+            int b = rng_next() % BLOBS;
+            c[1] = rng_gauss(centre[b][1], 30);
+            c[0] = rng_gauss(centre[b][0], 30);
+            for (int k = 2; k < dim; k++)
+                c[k] = rng_gauss(centre[b][k], 30);
+        }
+        else if (!strcmp(argv[1], "dup"))
+        {
+            // only a few distinct positions, so most distances tie
+            int p = rng_next() % DUP_POINTS;
+            c[0] = (p % 8) * 125;
+            c[1] = (p / 8) * 125;
+            for (int k = 2; k < dim; k++)
+                c[k] = (p * (k + 1) % 8) * 125;
+        }
+        else if (!strcmp(argv[1], "grid"))
+        {
+            // lattice points, many pairs have exactly the same distance
+            c[1] = (rng_next() % 21) * 50;
+            c[0] = (rng_next() % 21) * 50;
+            for (int k = 2; k < dim; k++)
+                c[k] = (rng_next() % 21) * 50;
+        }
+        else if (!strcmp(argv[1], "line"))
+        {
+            double t = rng_unit() * COORD_MAX;
+            c[0] = t;
+            c[1] = 0.5 * t + 250 + rng_gauss(0, 2);
+            for (int k = 2; k < dim; k++)
+                c[k] = (k % 4 + 1) * 0.2 * t + rng_gauss(0, 2);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown dataset kind %s\n", argv[1]);
+            return 1;
+        }
+        emit(id, c, dim);
+    }
+
+    return 0;
+}
@@ -0,0 +1,395 @@
+/*
+*
+*  @brief     Microbenchmark of distance kernels
+*  @details   Times every variant of linkage_distance on cluster pairs for
+*             every metric, pruned and hull based variants live only here
+*  @author    Matej Soroka
+*
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../alloc.h"
+#include "../cluster.h"
+#include "../kernel.h"
+#include "../stats.h"
+
+/// Minimal measured time of one case in seconds
+#define MICRO_TIME 0.2
+
+/// Kernel variants
+enum variant {
+    VARIANT_SCALAR, ///< linkage_distance
+    VARIANT_SSE2,   ///< kernel_linkage with SSE2
+    VARIANT_AVX2,   ///< kernel_linkage with AVX2
+    VARIANT_PRUNED, ///< kernel_pruned
+    VARIANT_HULL,   ///< kernel_hull
+    VARIANT_COUNT
+};
+
+/// Names of variants
+static const char *variant_names[VARIANT_COUNT] = {
+    "scalar", "sse2", "avx2", "pruned", "hull"
+};
+
+/// State of generator
+static unsigned long long rng_state = 1;
+
+/**
+*  Next pseudo random coordinate from interval [0, 1000)
+*  @return coordinate
+*/
+static float rng_coord(void)
+{
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (rng_state >> 40) * (1000.0f / 16777216.0f);
+}
+
+/**
+*  Creates cluster of random objects, c2 is shifted so clusters don't overlap
+*  @param c pointer to cluster
+*  @param n number of objects
+*  @param shift shift of x coordinates
+*/
+static void random_cluster(struct cluster_t *c, int n, float shift)
+{
+    struct obj_t o = { 0, 0, 0, 2, NULL };
+
+    init_cluster(c, n);
+    for (int i = 0; i < n; i++)
+    {
+        o.id = i;
+        o.x = rng_coord() / 2 + shift;
+        o.y = rng_coord();
+        append_cluster(c, o);
+    }
+}
+
+/// Coordinates of object, used for sorting objects
+struct sorted_obj {
+    float x; ///< x coordinate
+    float y; ///< y coordinate
+};
+
+/**
+*  Compares objects by x
+*  @param a pointer to struct sorted_obj
+*  @param b pointer to struct sorted_obj
+*  @return negative, zero or positive value like strcmp
+*/
+static int sorted_obj_compar(const void *a, const void *b)
+{
+    const struct sorted_obj *o1 = a;
+    const struct sorted_obj *o2 = b;
+    return (o1->x > o2->x) - (o1->x < o2->x);
+}
+
+/**
+*  linkage_distance which skips pairs that can't change the result. Objects
+*  of c2 are sorted by x and scanned outwards (--min) or inwards (--max)
+*  until difference in x alone decides. Average, objects of more than two
+*  coordinates and metrics other than Euclidean use kernel_linkage.
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method one of enum method
+*  @return distance between two clusters, equal to linkage_distance
+*/
+static float kernel_pruned(struct cluster_t *c1, struct cluster_t *c2, int method)
+{
+    if (method == METHOD_AVG || CLUSTER_OBJ(c1)[0].dim > 2 || kernel_metric() != METRIC_EUCLIDEAN)
+        return kernel_linkage(c1, c2, method);
+
+    struct obj_t *o1 = CLUSTER_OBJ(c1);
+    struct obj_t *o2 = CLUSTER_OBJ(c2);
+    int n = c2->size;
+    struct sorted_obj *s = xmalloc(sizeof(struct sorted_obj) * n);
+    if (s == NULL)
+        return linkage_distance(c1, c2, method);
+
+    float ymin = o2[0].y, ymax = o2[0].y;
+    for (int j = 0; j < n; j++)
+    {
+        s[j].x = o2[j].x;
+        s[j].y = o2[j].y;
+        if (s[j].y < ymin) ymin = s[j].y;
+        if (s[j].y > ymax) ymax = s[j].y;
+    }
+    qsort(s, n, sizeof(struct sorted_obj), sorted_obj_compar);
+
+    float best = obj_distance(&o1[0], &o2[0]);
+
+    for (int i = 0; i < c1->size; i++)
+    {
+        struct obj_t *o = &o1[i];
+
+        if (method == METHOD_MIN)
+        {
+            // first object with x >= o->x, then scan to both sides
+            int lo = 0, hi = n;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (s[mid].x < o->x)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+            // distance is at least |dx|, once |dx| > best no pair is closer
+            for (int j = lo; j < n && fabsf(o->x - s[j].x) <= best; j++)
+            {
+                float d = kernel_metric_xy(o->x, o->y, s[j].x, s[j].y, METRIC_EUCLIDEAN);
+                if (best > d)
+                    best = d;
+            }
+            for (int j = lo - 1; j >= 0 && fabsf(o->x - s[j].x) <= best; j--)
+            {
+                float d = kernel_metric_xy(o->x, o->y, s[j].x, s[j].y, METRIC_EUCLIDEAN);
+                if (best > d)
+                    best = d;
+            }
+        }
+        else
+        {
+            // pairs come in order of decreasing |dx| and the furthest |dy| is
+            // known, the bound uses the same float operations as obj_distance
+            // so it is never below distance of any remaining pair
+            float b = fabsf(o->y - ymin) > fabsf(o->y - ymax) ? o->y - ymin : o->y - ymax;
+            int lo = 0, hi = n - 1;
+            while (lo <= hi)
+            {
+                int j = fabsf(o->x - s[lo].x) >= fabsf(o->x - s[hi].x) ? lo++ : hi--;
+
+                float a = o->x - s[j].x;
+                if (sqrtf(a * a + b * b) <= best)
+                    break;
+
+                float d = kernel_metric_xy(o->x, o->y, s[j].x, s[j].y, METRIC_EUCLIDEAN);
+                if (best < d)
+                    best = d;
+            }
+        }
+    }
+
+    xfree(s);
+    return best;
+}
+
+/**
+*  Cross product of vectors ab and ac
+*/
+static double cross(const struct sorted_obj *a, const struct sorted_obj *b, const struct sorted_obj *c)
+{
+    return ((double)b->x - a->x) * ((double)c->y - a->y) - ((double)b->y - a->y) * ((double)c->x - a->x);
+}
+
+/**
+*  Compares objects by x, then y
+*  @param a pointer to struct sorted_obj
+*  @param b pointer to struct sorted_obj
+*  @return negative, zero or positive value like strcmp
+*/
+static int sorted_obj_compar_xy(const void *a, const void *b)
+{
+    const struct sorted_obj *o1 = a;
+    const struct sorted_obj *o2 = b;
+    if (o1->x != o2->x)
+        return (o1->x > o2->x) - (o1->x < o2->x);
+    return (o1->y > o2->y) - (o1->y < o2->y);
+}
+
+/**
+*  Convex hull of cluster (monotone chain), collinear points are dropped
+*  @param c pointer to cluster
+*  @param p array of size points for sorting
+*  @param hull array for 2 * size vertices
+*  @return number of vertices
+*/
+static int cluster_hull(struct cluster_t *c, struct sorted_obj *p, struct sorted_obj *hull)
+{
+    struct obj_t *o = CLUSTER_OBJ(c);
+    int n = c->size;
+    int k = 0;
+
+    for (int j = 0; j < n; j++)
+    {
+        p[j].x = o[j].x;
+        p[j].y = o[j].y;
+    }
+    qsort(p, n, sizeof(struct sorted_obj), sorted_obj_compar_xy);
+
+    if (n < 3)
+    {
+        memcpy(hull, p, sizeof(struct sorted_obj) * n);
+        return n;
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        while (k >= 2 && cross(&hull[k - 2], &hull[k - 1], &p[j]) <= 0)
+            k--;
+        hull[k++] = p[j];
+    }
+    for (int j = n - 2, t = k + 1; j >= 0; j--)
+    {
+        while (k >= t && cross(&hull[k - 2], &hull[k - 1], &p[j]) <= 0)
+            k--;
+        hull[k++] = p[j];
+    }
+
+    // last vertex is the first one again
+    return k - 1;
+}
+
+/**
+*  linkage_distance of --max over vertices of convex hulls of both clusters,
+*  the furthest pair of two point sets always lies on their hulls. Other
+*  methods use kernel_linkage. Result may differ from linkage_distance in
+*  the last bit when an inner point is within rounding of the furthest.
+*  Objects of more than two coordinates and metrics other than Euclidean use
+*  kernel_linkage.
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method one of enum method
+*  @return distance between two clusters
+*/
+static float kernel_hull(struct cluster_t *c1, struct cluster_t *c2, int method)
+{
+    if (method != METHOD_MAX || CLUSTER_OBJ(c1)[0].dim > 2 || kernel_metric() != METRIC_EUCLIDEAN)
+        return kernel_linkage(c1, c2, method);
+
+    int n = c1->size > c2->size ? c1->size : c2->size;
+    struct sorted_obj *h1 = xmalloc(sizeof(struct sorted_obj) * 5 * n);
+    if (h1 == NULL)
+        return linkage_distance(c1, c2, method);
+    struct sorted_obj *h2 = h1 + 2 * n;
+
+    int n1 = cluster_hull(c1, h2, h1);
+    int n2 = cluster_hull(c2, h1 + 4 * n, h2);
+    float best = obj_distance(&CLUSTER_OBJ(c1)[0], &CLUSTER_OBJ(c2)[0]);
+
+    for (int i = 0; i < n1; i++)
+    {
+        for (int j = 0; j < n2; j++)
+        {
+            float d = kernel_metric_xy(h1[i].x, h1[i].y, h2[j].x, h2[j].y, METRIC_EUCLIDEAN);
+            if (best < d)
+                best = d;
+        }
+    }
+
+    xfree(h1);
+    return best;
+}
+
+/**
+*  Computes distance by variant
+*  @param v variant
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method cluster distance method
+*  @return distance
+*/
+static float run_variant(int v, struct cluster_t *c1, struct cluster_t *c2, int method)
+{
+    switch (v)
+    {
+        case VARIANT_SCALAR:
+            return linkage_distance(c1, c2, method);
+        case VARIANT_SSE2:
+        case VARIANT_AVX2:
+            return kernel_linkage(c1, c2, method);
+        case VARIANT_PRUNED:
+            return kernel_pruned(c1, c2, method);
+        default:
+            return kernel_hull(c1, c2, method);
+    }
+}
+
+/**
+*  Times every variant on clusters of n1 and n2 objects for every metric
+*  and method and prints one line per case
+*  @param n1 number of objects of first cluster
+*  @param n2 number of objects of second cluster
+*  @param best_isa instruction set of variants without their own
+*/
+static void run_case(int n1, int n2, int best_isa)
+{
+    struct cluster_t c1, c2;
+    random_cluster(&c1, n1, 0);
+    random_cluster(&c2, n2, 500);
+
+    for (int metric = 0; metric < METRIC_COUNT; metric++)
+    for (int method = METHOD_AVG; method <= METHOD_MAX; method++)
+    {
+        kernel_select_metric(metric);
+        kernel_select(ISA_SCALAR);
+        float expected = linkage_distance(&c1, &c2, method);
+
+        for (int v = 0; v < VARIANT_COUNT; v++)
+        {
+            int isa = v == VARIANT_SSE2 ? ISA_SSE2 : v == VARIANT_AVX2 ? ISA_AVX2 : best_isa;
+            // pruning and hulls are Euclidean only, others fall back
+            if (!kernel_select(isa) || (v >= VARIANT_PRUNED && metric != METRIC_EUCLIDEAN))
+                continue;
+
+            volatile float sink = run_variant(v, &c1, &c2, method);
+            int exact = sink == expected;
+            long calls = 0;
+            double start = stats_now(), elapsed;
+
+            do
+            {
+                sink = run_variant(v, &c1, &c2, method);
+                calls++;
+            } while ((elapsed = stats_now() - start) < MICRO_TIME);
+
+            double pairs = (double)calls * n1 * n2;
+            double bytes = (double)calls * (n1 + (double)n1 * n2) * sizeof(struct obj_t);
+            printf("%s,%s,%s,%d,%d,%.3f,%.3f,%s\n", metric_names[metric], method_names[method], variant_names[v],
+                   n1, n2, elapsed * 1e9 / pairs, bytes / elapsed / 1e9, exact ? "yes" : "no");
+            fflush(stdout);
+        }
+    }
+
+    clear_cluster(&c1);
+    clear_cluster(&c2);
+}
+
+/**
+*  Main function
+*  @param argc number of arguments
+*  @param argv [MAXN]
+*  @return zero if program is successful
+*/
+int main(int argc, char *argv[])
+{
+    int maxn = argc > 1 ? atoi(argv[1]) : 10000;
+    int best_isa = isa_by_name("auto");
+
+    if (maxn < 1)
+    {
+        fprintf(stderr, "Usage: %s [MAXN]\n", argv[0]);
+        return 1;
+    }
+
+    // bytes = objects of c1 once and objects of c2 once for each of c1
+    printf("metric,method,variant,n1,n2,ns_per_pair,gb_per_s,exact\n");
+
+    for (int n = 1; n <= maxn; n *= 10)
+        run_case(n, n, best_isa);
+
+    // pruning sorts the second cluster and hulls pay for both clusters, so
+    // they behave differently when one cluster is much smaller
+    for (int n = 1; n * n < maxn; n *= 10)
+    {
+        run_case(n, maxn / n, best_isa);
+        run_case(maxn / n, n, best_isa);
+    }
+
+    return 0;
+}
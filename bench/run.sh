@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Benchmark driver. Generates datasets with bench/gen, runs proj3 for each
+# method and engine and writes one CSV row per measured phase. Phase times
+# come from --stats=json, the "total" row is wall time of the process.
+#
+# Environment:
+#   KINDS    dataset kinds          (default: uniform gauss dup grid line)
+#   SIZES    object counts          (default: 100 300 1000)
+#   METHODS  linkage methods        (default: all methods)
+#   ENGINES  engines                (default: all engines)
+#   SEED     generator seed         (default: 1)
+#   N        final cluster count    (default: 5)
+#   LIMIT    seconds per run        (default: 600)
+#   OUT      result file           (default: bench/results.csv)
+#
+# Sizes up to 1000000 are supported by the generator; runs over LIMIT are
+# recorded with status "timeout" instead of a time. Engine nnchain runs only
+# --ward and engine generic only --ward, --centroid and --median, other
+# pairs are skipped.
+
+set -u
+
+dir=$(dirname "$0")
+proj=${PROJ:-$dir/../proj3}
+gen=$dir/gen
+data=${DATA:-$dir/data}
+
+KINDS=${KINDS:-"uniform gauss dup grid line"}
+SIZES=${SIZES:-"100 300 1000"}
+METHODS=${METHODS:-"--avg --min --max --ward --centroid --median"}
+ENGINES=${ENGINES:-"ref matrix nnchain generic"}
+SEED=${SEED:-1}
+N=${N:-5}
+LIMIT=${LIMIT:-600}
+OUT=${OUT:-$dir/results.csv}
+
+stats=$(mktemp)
+trap 'rm -f "$stats"' EXIT
+
+mkdir -p "$data"
+echo "kind,n,seed,method,engine,phase,seconds,status" > "$OUT"
+
+now() { date +%s.%N; }
+
+for kind in $KINDS; do
+    for n in $SIZES; do
+        file=$data/$kind-$n-$SEED.txt
+        [ -f "$file" ] || "$gen" "$kind" "$n" "$SEED" > "$file" || exit 1
+
+        for method in $METHODS; do
+            for engine in $ENGINES; do
+                case $engine:$method in
+                    nnchain:--ward) ;;
+                    nnchain:*) continue ;;
+                    generic:--ward|generic:--centroid|generic:--median) ;;
+                    generic:*) continue ;;
+                esac
+                opts=""
+                [ "$engine" = default ] || opts="--engine=$engine"
+
+                t0=$(now)
+                timeout "$LIMIT" "$proj" "$file" "$N" "$method" $opts \
+                    --stats=json > /dev/null 2> "$stats"
+                rc=$?
+                t1=$(now)
+
+                status=ok
+                [ $rc -eq 124 ] && status=timeout
+                [ $rc -ne 0 ] && [ $rc -ne 124 ] && status=error
+
+                secs=$(echo "$t0 $t1" | awk '{ printf "%.6f", $2 - $1 }')
+                if [ $status = ok ]; then
+                    # one "phase": seconds pair per line inside "time" object
+                    awk -v pre="$kind,$n,$SEED,${method#--},$engine" '
+                        /"time": \{/ { in_time = 1; next }
+                        in_time && /\}/ { in_time = 0 }
+                        in_time {
+                            gsub(/[",:]/, " ")
+                            printf "%s,%s,%s,ok\n", pre, $1, $2
+                        }' "$stats" >> "$OUT"
+                fi
+                echo "$kind,$n,$SEED,${method#--},$engine,total,$secs,$status" >> "$OUT"
+                echo "$kind n=$n ${method#--} $engine: ${secs}s $status" >&2
+            done
+        done
+    done
+done
@@ -0,0 +1,366 @@
+/*
+*
+*  @brief     Bootstrap stability
+*  @details   Clusters resamples of objects and reports how often clusters
+*             and their objects are found again
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "bootstrap.h"
+#include "numa.h"
+
+/// Arguments shared by resample workers
+struct resamples {
+    const struct obj_t *obj;  ///< objects in order of positions
+    const float *dist;        ///< condensed distances of objects or NULL
+    int n;                    ///< number of objects
+    int k;                    ///< number of clusters
+    int count;                ///< number of resamples
+    int threads;              ///< number of workers
+    const int *ref;           ///< cluster of object in full run
+    struct engine_opts opts;  ///< engine and method of resamples
+    double *jaccard;          ///< best Jaccard index of resample b and
+                              ///< cluster r at b * k + r, -1 if r is absent
+};
+
+/// Arguments of resample worker
+struct resample_worker {
+    struct resamples *s;      ///< shared arguments
+    int first;                ///< first resample of worker
+    long long *together;      ///< co-members of object found with it
+    long long *present;       ///< co-members of object present
+    int failed;               ///< memory can't be allocated
+};
+
+/// Entry of co-assignment output
+struct coassign {
+    int cluster;  ///< cluster of full run
+    int id;       ///< id of object
+    int i;        ///< position of object
+};
+
+/**
+*  Next number of generator of resample (splitmix64)
+*  @ingroup bootstrap
+*  @param state state of generator
+*  @return pseudo random number
+*/
+static uint64_t resample_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+*  Draws resample b, objects are sorted by counting, so positions of
+*  resample are in order of objects like positions of the full run
+*  @ingroup bootstrap
+*  @param n number of objects
+*  @param b resample
+*  @param idx array for objects of n positions
+*  @param first array for first position of every object, -1 if absent
+*/
+static void resample_draw(int n, int b, int *idx, int *first)
+{
+    uint64_t state = b;
+
+    memset(first, 0, sizeof(int) * n);
+    for (int p = 0; p < n; p++)
+        first[(resample_next(&state) >> 32) * n >> 32]++;
+
+    int pos = 0;
+    for (int x = 0; x < n; x++)
+    {
+        int copies = first[x];
+        first[x] = copies ? pos : -1;
+        while (copies--)
+            idx[pos++] = x;
+    }
+}
+
+/**
+*  Compares entries of co-assignment by cluster, id and position
+*  @ingroup bootstrap
+*  @param a first entry
+*  @param b second entry
+*  @return negative, zero or positive like strcmp
+*/
+static int coassign_cmp(const void *a, const void *b)
+{
+    const struct coassign *x = a, *y = b;
+
+    if (x->cluster != y->cluster)
+        return x->cluster < y->cluster ? -1 : 1;
+    if (x->id != y->id)
+        return x->id < y->id ? -1 : 1;
+    return (x->i > y->i) - (x->i < y->i);
+}
+
+/**
+*  Clusters resamples first, first + threads, ... and compares their
+*  clusters with clusters of the full run
+*  @ingroup bootstrap
+*  @param arg pointer to struct resample_worker
+*  @return NULL
+*/
+static void *resample_rows(void *arg)
+{
+    struct resample_worker *w = arg;
+    struct resamples *s = w->s;
+    int n = s->n, k = s->k;
+    int pinned = numa_pin();
+    struct engine_ws ws = { NULL, 0 };
+    struct engine_opts o = s->opts;
+    struct dendro d = { 0, 0, NULL };
+    struct cluster_t *carr = xmalloc(sizeof(struct cluster_t) * n);
+    int *idx = xmalloc(sizeof(int) * ((size_t)4 * n + (size_t)k * k + 2 * k));
+
+    if (carr == NULL || idx == NULL || !dendro_init(&d, n))
+    {
+        w->failed = 1;
+        xfree(carr);
+        xfree(idx);
+        numa_unpin(pinned);
+        return NULL;
+    }
+
+    int *first = idx + n;
+    int *owner = first + n;
+    int *label = owner + n;
+    int *tab = label + n;
+    int *rsize = tab + (size_t)k * k;
+    int *csize = rsize + k;
+
+    o.threads = 1;
+    o.ws = &ws;
+    o.dendro = &d;
+    o.dist = s->dist;
+    o.index = s->dist ? idx : NULL;
+    o.dist_n = n;
+
+    for (int b = w->first; b < s->count && !w->failed; b += s->threads)
+    {
+        resample_draw(n, b, idx, first);
+
+        for (int p = 0; p < n; p++)
+        {
+            init_cluster(&carr[p], 1);
+            append_cluster(&carr[p], s->obj[idx[p]]);
+            w->failed |= carr[p].size != 1;
+        }
+
+        d.count = 0;
+        int left = w->failed ? -1 : engine_run(carr, n, k, &o);
+        for (int p = 0; p < (left < 0 ? n : left); p++)
+            clear_cluster(&carr[p]);
+        if (left < 0)
+        {
+            w->failed = 1;
+            break;
+        }
+
+        // clusters of resample numbered in order of position like clusters
+        // of the full run, merged positions point to lower positions
+        dendro_owners(&d, k, owner);
+        int c = 0;
+        for (int p = 0; p < n; p++)
+            label[p] = owner[p] == p ? c++ : label[owner[p]];
+
+        // contingency of full run and resample over present objects
+        memset(tab, 0, sizeof(int) * ((size_t)k * k + 2 * k));
+        for (int x = 0; x < n; x++)
+            if (first[x] >= 0)
+            {
+                int r = s->ref[x], l = label[first[x]];
+                tab[(size_t)r * k + l]++;
+                rsize[l]++;
+                csize[r]++;
+            }
+
+        for (int x = 0; x < n; x++)
+            if (first[x] >= 0)
+            {
+                int r = s->ref[x];
+                w->together[x] += tab[(size_t)r * k + label[first[x]]] - 1;
+                w->present[x] += csize[r] - 1;
+            }
+
+        for (int r = 0; r < k; r++)
+        {
+            double best = csize[r] ? 0 : -1;
+            for (int l = 0; l < k; l++)
+            {
+                int t = tab[(size_t)r * k + l];
+                if (t && (double)t / (csize[r] + rsize[l] - t) > best)
+                    best = (double)t / (csize[r] + rsize[l] - t);
+            }
+            s->jaccard[(size_t)b * k + r] = best;
+        }
+    }
+
+    dendro_free(&d);
+    engine_ws_free(&ws);
+    xfree(carr);
+    xfree(idx);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+int bootstrap_run(struct cluster_t *carr, int size, int narr, int count, const struct engine_opts *opts)
+{
+    struct engine_opts o = *opts;
+    struct resamples s;
+    struct dendro d = { 0, 0, NULL };
+    struct obj_t *obj = xmalloc(sizeof(struct obj_t) * size);
+    int *ref = xmalloc(sizeof(int) * size);
+    double *jaccard = xmalloc(sizeof(double) * count * narr);
+    float *dist = NULL;
+    int threads = opts->threads < count ? opts->threads : count;
+    long long *sums = xmalloc(sizeof(long long) * 2 * size * threads);
+    int ok = obj && ref && jaccard && sums;
+    int left = size;
+
+    for (int i = 0; ok && i < size; i++)
+    {
+        ok = carr[i].size == 1;
+        obj[i] = CLUSTER_OBJ(&carr[i])[0];
+    }
+
+    // methods computed from centroids don't use distances of objects, other
+    // methods run on matrix engine to take rows of the shared matrix
+    if (!method_centroid(opts->method))
+    {
+        o.engine = ENGINE_MATRIX;
+        if (ok && !(dist = distance_matrix(obj, size, opts->threads)))
+            ok = 0;
+    }
+
+    if (ok && (ok = dendro_init(&d, size)))
+    {
+        o.dendro = &d;
+        o.dist = dist;
+        if ((ok = (left = engine_run(carr, size, narr, &o)) >= 0))
+        {
+            dendro_owners(&d, narr, ref);
+            int c = 0;
+            for (int i = 0; i < size; i++)
+                ref[i] = ref[i] == i ? c++ : ref[ref[i]];
+        }
+        else
+            left = 0;
+    }
+
+    if (ok)
+    {
+        pthread_t tid[threads];
+        struct resample_worker arg[threads];
+        int started[threads];
+
+        s.obj = obj;
+        s.dist = dist;
+        s.n = size;
+        s.k = narr;
+        s.count = count;
+        s.threads = threads;
+        s.ref = ref;
+        s.opts = o;
+        s.jaccard = jaccard;
+        memset(sums, 0, sizeof(long long) * 2 * size * threads);
+
+        for (int t = 0; t < threads; t++)
+        {
+            arg[t].s = &s;
+            arg[t].first = t;
+            arg[t].together = sums + (size_t)2 * size * t;
+            arg[t].present = arg[t].together + size;
+            arg[t].failed = 0;
+            started[t] = t > 0 && !pthread_create(&tid[t], NULL, resample_rows, &arg[t]);
+        }
+
+        // this thread takes resamples of its own and of threads which didn't start
+        for (int t = 0; t < threads; t++)
+            if (!started[t])
+                resample_rows(&arg[t]);
+
+        for (int t = 0; t < threads; t++)
+        {
+            if (started[t])
+                pthread_join(tid[t], NULL);
+            ok &= !arg[t].failed;
+        }
+    }
+
+    struct coassign *order = ok ? xmalloc(sizeof(struct coassign) * size) : NULL;
+    if (order)
+    {
+        print_clusters(carr, left);
+
+        // sums in order of resamples, so they don't depend on threads
+        printf("Bootstrap of %d resamples:\n", count);
+        for (int r = 0; r < narr; r++)
+        {
+            double total = 0;
+            int found = 0;
+            for (int b = 0; b < count; b++)
+                if (jaccard[(size_t)b * narr + r] >= 0)
+                {
+                    total += jaccard[(size_t)b * narr + r];
+                    found++;
+                }
+            printf("cluster %d: stability %.6f\n", r, found ? total / found : 0.0);
+        }
+
+        for (int t = 1; t < threads; t++)
+            for (int i = 0; i < 2 * size; i++)
+                sums[i] += sums[(size_t)2 * size * t + i];
+
+        for (int i = 0; i < size; i++)
+        {
+            order[i].cluster = ref[i];
+            order[i].id = obj[i].id;
+            order[i].i = i;
+        }
+        qsort(order, size, sizeof(struct coassign), coassign_cmp);
+
+        // object without co-members present was trivially kept with them
+        printf("Co-assignment:\n");
+        for (int i = 0; i < size; i++)
+        {
+            int x = order[i].i;
+            if (i == 0 || order[i - 1].cluster != order[i].cluster)
+                printf("cluster %d:", order[i].cluster);
+            printf(" %d[%.3f]", order[i].id,
+                   sums[size + x] ? (double)sums[x] / sums[size + x] : 1.0);
+            if (i == size - 1 || order[i + 1].cluster != order[i].cluster)
+                putchar('\n');
+        }
+    }
+    else
+    {
+        ok = 0;
+        fprintf(stderr, "Resamples can't be clustered\n");
+    }
+
+    for (int i = 0; i < left; i++)
+        clear_cluster(&carr[i]);
+    xfree(carr);
+
+    if (d.merges)
+        dendro_free(&d);
+    xfree(order);
+    xfree(sums);
+    xfree(jaccard);
+    xfree(dist);
+    xfree(ref);
+    xfree(obj);
+    return ok ? 0 : -1;
+}
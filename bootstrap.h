@@ -0,0 +1,53 @@
+/*
+*
+*  @brief     Bootstrap stability
+*  @details   Clusters resamples of objects and reports how often clusters
+*             and their objects are found again
+*  @author    Matej Soroka
+*
+*/
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include "engine.h"
+
+///@defgroup bootstrap Bootstrap stability
+
+/*
+ A resample draws n objects of the input with replacement, so about 63 %
+ of objects are present, some of them several times. Distances of objects
+ don't change between resamples, so the condensed matrix of all objects is
+ computed once and the matrix engine of every resample takes its rows by
+ index of objects instead of computing obj_distance again. Repeated copies
+ of an object are singletons of their own at distance of the object to
+ itself, they are merged first and the object is labelled by its first
+ copy.
+
+ Resamples are split between threads, resample b is drawn from its own
+ generator seeded by b, so results don't depend on --threads. Every
+ thread keeps its own matrix of n * (n - 1) / 2 distances next to the
+ shared one. Methods computed from centroids don't use the matrix, they
+ run their own engine on copies of objects.
+
+ Stability of a cluster of the full run is the mean over resamples of the
+ highest Jaccard index of its present objects and a cluster of the
+ resample. Co-assignment of an object is the fraction of its present
+ co-members in resamples which were in its resample cluster as well.
+*/
+
+/**
+*  Clusters loaded singletons into narr clusters, clusters count resamples
+*  of them the same way and prints clusters with stability of every cluster
+*  and co-assignment frequency of every object
+*  @ingroup bootstrap
+*  @param carr array of loaded singletons, it is freed
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param count number of resamples
+*  @param opts method and threads
+*  @pre narr must be between one and size
+*  @return zero or -1 on error
+*/
+int bootstrap_run(struct cluster_t *carr, int size, int narr, int count, const struct engine_opts *opts);
+
+#endif
@@ -0,0 +1,400 @@
+/*
+*
+*  @brief     Result cache
+*  @details   Dendrograms stored in directory under hash of input objects
+*  @author    Matej Soroka
+*
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "alloc.h"
+#include "cache.h"
+#include "kernel.h"
+
+const char *cache_dir = NULL;
+unsigned long long cache_limit = 1ULL << 30;
+
+/// Suffix of cache files
+#define CACHE_SUFFIX ".dendro"
+
+/// @struct cache_header
+/// Beginning of cache file, merges follow, then objects of input as id,
+/// number of coordinates and the coordinates
+struct cache_header {
+    char magic[8];   ///< "PROJ3DG\3"
+    uint64_t key;    ///< key of input
+    int32_t n;       ///< number of objects
+    int32_t count;   ///< number of merges
+    int32_t method;  ///< cluster distance method
+    int32_t metric;  ///< distance of objects
+};
+
+static const char cache_magic[8] = "PROJ3DG\3";
+
+/**
+*  FNV-1a hash of bytes
+*  @ingroup cache
+*  @param h hash so far
+*  @param p bytes
+*  @param len number of bytes
+*  @return new hash
+*/
+static uint64_t fnv1a(uint64_t h, const void *p, size_t len)
+{
+    const unsigned char *b = p;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= b[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t cache_key(const struct obj_t *obj, int n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h = fnv1a(h, &n, sizeof(n));
+    for (int i = 0; i < n; i++)
+    {
+        h = fnv1a(h, &obj[i].id, sizeof(obj[i].id));
+        h = fnv1a(h, &obj[i].x, sizeof(obj[i].x));
+        h = fnv1a(h, &obj[i].y, sizeof(obj[i].y));
+        if (obj[i].dim > 2)
+            h = fnv1a(h, obj[i].v, sizeof(float) * obj[i].dim);
+    }
+
+    // keys of Euclidean results are the same as before metrics were added
+    int metric = kernel_metric();
+    if (metric != METRIC_EUCLIDEAN)
+        h = fnv1a(h, metric_names[metric], strlen(metric_names[metric]));
+    return h;
+}
+
+/**
+*  Coordinates of object as they are stored in cache file
+*  @ingroup cache
+*  @param o object
+*  @param xy buffer for two coordinates
+*  @return dim coordinates of object
+*/
+static const float *cache_coords(const struct obj_t *o, float xy[2])
+{
+    if (o->dim > 2)
+        return o->v;
+    xy[0] = o->x;
+    xy[1] = o->y;
+    return xy;
+}
+
+/**
+*  Compares objects stored after merges with objects of input, key is only
+*  a hash, so a different input with the same key must not be a hit
+*  @ingroup cache
+*  @param f file positioned after merges
+*  @param obj objects of input
+*  @param n number of objects
+*  @return 1 if objects are equal, 0 if they differ, -1 if file is damaged
+*/
+static int cache_verify(FILE *f, const struct obj_t *obj, int n)
+{
+    float *buf = NULL, xy[2];
+    int cap = 0, equal = 1;
+
+    for (int i = 0; i < n; i++)
+    {
+        int32_t rec[2];
+        if (fread(rec, sizeof(rec), 1, f) != 1)
+            equal = -1;
+        else if (rec[0] != obj[i].id || rec[1] != obj[i].dim)
+            equal = 0;
+        if (equal <= 0)
+            break;
+
+        int dim = obj[i].dim;
+        if (dim > cap)
+        {
+            float *tmp = xrealloc(buf, sizeof(float) * dim);
+            if (tmp == NULL)
+            {
+                equal = 0;
+                break;
+            }
+            buf = tmp;
+            cap = dim;
+        }
+        if ((int)fread(buf, sizeof(float), dim, f) != dim)
+            equal = -1;
+        else if (memcmp(buf, cache_coords(&obj[i], xy), sizeof(float) * dim))
+            equal = 0;
+        if (equal <= 0)
+            break;
+    }
+
+    // anything after the objects is not a file written by cache_store
+    if (equal > 0 && fgetc(f) != EOF)
+        equal = -1;
+    xfree(buf);
+    return equal;
+}
+
+/**
+*  Formats path of cache file
+*  @ingroup cache
+*  @param buf buffer for path
+*  @param size size of buffer
+*  @param key key of input
+*  @param method cluster distance method
+*/
+static void cache_path(char *buf, size_t size, uint64_t key, int method)
+{
+    snprintf(buf, size, "%s/%016llx.%s" CACHE_SUFFIX, cache_dir,
+             (unsigned long long)key, method_names[method]);
+}
+
+int cache_load(uint64_t key, const struct obj_t *obj, int n, int method, struct dendro *d)
+{
+    char path[4096];
+    struct cache_header h;
+
+    cache_path(path, sizeof(path), key, method);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return 0;
+
+    int valid = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, cache_magic, 8) &&
+                h.key == key && h.n == n && h.method == method && h.count == (n > 1 ? n - 1 : 0);
+    int ok = valid && dendro_init(d, n);
+
+    if (ok && (int)fread(d->merges, sizeof(struct merge), h.count, f) != h.count)
+        valid = 0;
+
+    // other input or metric of the same key is a miss, its file is replaced
+    // by cache_store of this input
+    int same = 0;
+    if (ok && valid && h.metric == kernel_metric() && (same = cache_verify(f, obj, n)) < 0)
+        valid = 0;
+    fclose(f);
+    if (ok && valid && !same)
+    {
+        dendro_free(d);
+        return 0;
+    }
+
+    // damaged file must not make dendro_cut or dendro_layout_init index out
+    // of bounds, both positions of a merge must be in range and not merged
+    // away by an earlier merge
+    char *removed = ok && valid ? xmalloc(n ? n : 1) : NULL;
+    if (removed)
+    {
+        memset(removed, 0, n);
+        for (int m = 0; valid && m < h.count; m++)
+        {
+            int a = d->merges[m].a, b = d->merges[m].b;
+            valid = a >= 0 && a < b && b < n && !removed[a] && !removed[b];
+            if (valid)
+                removed[b] = 1;
+        }
+    }
+
+    if (!ok || !valid || removed == NULL)
+    {
+        if (ok)
+            dendro_free(d);
+        // a damaged file is removed, so the result is computed and stored again
+        if (!valid)
+            unlink(path);
+        xfree(removed);
+        return 0;
+    }
+    xfree(removed);
+
+    d->count = h.count;
+    // modification time orders files for eviction
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return 1;
+}
+
+/// @struct cache_file
+/// File of cache directory considered for eviction
+struct cache_file {
+    char name[256];     ///< name in directory
+    off_t size;         ///< size in bytes
+    struct timespec t;  ///< time of last use
+};
+
+/**
+*  Compares files by time of last use
+*  @ingroup cache
+*  @param a first file
+*  @param b second file
+*  @return negative if a was used before b
+*/
+static int cache_file_cmp(const void *a, const void *b)
+{
+    const struct cache_file *fa = a, *fb = b;
+
+    if (fa->t.tv_sec != fb->t.tv_sec)
+        return fa->t.tv_sec < fb->t.tv_sec ? -1 : 1;
+    if (fa->t.tv_nsec != fb->t.tv_nsec)
+        return fa->t.tv_nsec < fb->t.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/**
+*  Removes least recently used files until cache fits into cache_limit
+*  @ingroup cache
+*/
+static void cache_evict(void)
+{
+    DIR *dir = opendir(cache_dir);
+    struct dirent *e;
+    struct cache_file *files = NULL;
+    int count = 0, cap = 0;
+    unsigned long long total = 0;
+    char path[4096];
+
+    if (dir == NULL)
+        return;
+
+    while ((e = readdir(dir)))
+    {
+        size_t len = strlen(e->d_name);
+        struct stat st;
+
+        if (len <= strlen(CACHE_SUFFIX) || len >= sizeof(files->name) ||
+            strcmp(e->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX))
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, e->d_name);
+        if (stat(path, &st) || !S_ISREG(st.st_mode))
+            continue;
+
+        if (count == cap)
+        {
+            cap = cap ? 2 * cap : 64;
+            struct cache_file *tmp = xrealloc(files, sizeof(struct cache_file) * cap);
+            if (tmp == NULL)
+                break;
+            files = tmp;
+        }
+        strcpy(files[count].name, e->d_name);
+        files[count].size = st.st_size;
+        files[count].t = st.st_mtim;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    qsort(files, count, sizeof(struct cache_file), cache_file_cmp);
+    for (int i = 0; i < count && total > cache_limit; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, files[i].name);
+        if (!unlink(path))
+            total -= files[i].size;
+    }
+    xfree(files);
+}
+
+int cache_store(uint64_t key, const struct obj_t *obj, int method, const struct dendro *d)
+{
+    char path[4096], tmp[4200];
+    struct cache_header h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cache_magic, 8);
+    h.key = key;
+    h.n = d->n;
+    h.count = d->count;
+    h.method = method;
+    h.metric = kernel_metric();
+
+    // written under temporary name and renamed, so readers never see a
+    // partial file, also when more processes share the directory
+    cache_path(path, sizeof(path), key, method);
+    static int serial;
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%d.tmp", path, (long)getpid(),
+             __atomic_fetch_add(&serial, 1, __ATOMIC_RELAXED));
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+        return 0;
+
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             (int)fwrite(d->merges, sizeof(struct merge), d->count, f) == d->count;
+    for (int i = 0; ok && i < d->n; i++)
+    {
+        int32_t rec[2] = { obj[i].id, obj[i].dim };
+        float xy[2];
+        ok = fwrite(rec, sizeof(rec), 1, f) == 1 &&
+             (int)fwrite(cache_coords(&obj[i], xy), sizeof(float), obj[i].dim, f) == obj[i].dim;
+    }
+    ok = !fclose(f) && ok && !rename(tmp, path);
+    if (!ok)
+        unlink(tmp);
+    else
+        cache_evict();
+    return ok;
+}
+
+int cache_run(struct cluster_t **carr, int size, int narr, const struct engine_opts *opts)
+{
+    struct engine_opts o = *opts;
+    struct dendro d;
+    struct obj_t *obj;
+
+    // dendrogram positions are objects, only input of singletons is cached
+    for (int i = 0; i < size; i++)
+        if ((*carr)[i].size != 1)
+            return engine_run(*carr, size, narr, opts);
+
+    if ((obj = xmalloc(sizeof(struct obj_t) * size)) == NULL)
+    {
+        fprintf(stderr, "Memory allocation was not succeed\n");
+        return -1;
+    }
+    for (int i = 0; i < size; i++)
+        obj[i] = CLUSTER_OBJ(&(*carr)[i])[0];
+
+    uint64_t key = cache_key(obj, size);
+    if (!cache_load(key, obj, size, opts->method, &d))
+    {
+        if (!dendro_init(&d, size))
+        {
+            xfree(obj);
+            fprintf(stderr, "Memory allocation was not succeed\n");
+            return -1;
+        }
+
+        o.dendro = &d;
+        if ((size = engine_run(*carr, size, 1, &o)) < 0)
+        {
+            dendro_free(&d);
+            xfree(obj);
+            return -1;
+        }
+        if (!cache_store(key, obj, opts->method, &d))
+            fprintf(stderr, "Result can't be stored in cache\n");
+    }
+
+    for (int i = 0; i < size; i++)
+        clear_cluster(&(*carr)[i]);
+    xfree(*carr);
+    *carr = NULL;
+
+    int count = dendro_cut(&d, obj, narr, carr);
+    if (count < 0)
+        fprintf(stderr, "Memory allocation was not succeed\n");
+
+    dendro_free(&d);
+    xfree(obj);
+    return count;
+}
@@ -0,0 +1,79 @@
+/*
+*
+*  @brief     Result cache
+*  @details   Dendrograms stored in directory under hash of input objects
+*  @author    Matej Soroka
+*
+*/
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "engine.h"
+
+///@defgroup cache Result cache
+
+/*
+ Entry of cache is the whole dendrogram of input, so every N of the same
+ objects and method is answered by dendro_cut without merging. Key is hash
+ of ids and coordinates of objects in order of file, not of its name, so
+ copies and renamed files share one entry. The objects and metric are
+ stored with the merges and compared on load, a file of other input under
+ the same key is a miss. Files not used for the longest
+ time are removed when directory grows over the limit.
+*/
+
+/// Directory of cache set by --cache, NULL if cache is not used
+extern const char *cache_dir;
+
+/// Largest total size of cache files in bytes
+extern unsigned long long cache_limit;
+
+/**
+*  Computes key of input
+*  @ingroup cache
+*  @param obj objects in order of file
+*  @param n number of objects
+*  @return 64-bit hash of ids, coordinates and selected metric
+*/
+uint64_t cache_key(const struct obj_t *obj, int n);
+
+/**
+*  Loads dendrogram from cache, objects and metric stored with it must be
+*  equal to those of input, so a collision of keys is a miss
+*  @ingroup cache
+*  @param key key of input
+*  @param obj objects in order of file
+*  @param n number of objects of input
+*  @param method cluster distance method
+*  @param d dendrogram to initialize
+*  @return nonzero if complete dendrogram was loaded
+*/
+int cache_load(uint64_t key, const struct obj_t *obj, int n, int method, struct dendro *d);
+
+/**
+*  Stores complete dendrogram in cache and evicts least recently used
+*  files over cache_limit
+*  @ingroup cache
+*  @param key key of input
+*  @param obj objects in order of file, d->n of them
+*  @param method cluster distance method
+*  @param d complete dendrogram
+*  @return nonzero if dendrogram was stored
+*/
+int cache_store(uint64_t key, const struct obj_t *obj, int method, const struct dendro *d);
+
+/**
+*  Replaces engine_run when cache is used. Array of singletons is answered
+*  from cache or merged down to one cluster, stored and cut to narr clusters.
+*  @ingroup cache
+*  @param carr pointer to array of clusters, array may be replaced
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected engine, method and threads
+*  @return number of clusters in array or -1 if memory can't be allocated
+*/
+int cache_run(struct cluster_t **carr, int size, int narr, const struct engine_opts *opts);
+
+#endif
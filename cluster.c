@@ -0,0 +1,907 @@
+/*
+*
+*  @brief     Simple cluster analysis
+*  @details   Objects, clusters and operations over them
+*  @author    Matej Soroka
+*  @date      12-13-2017
+*
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "cluster.h"
+#include "kernel.h"
+#include "stats.h"
+#include "numa.h"
+
+/**
+*  Init of cluster. Allocate memory for capacity of object, capacity up to
+*  CLUSTER_INLINE is stored in cluster itself
+*  @ingroup cluster
+*  @param c pointer to cluster
+*  @param cap capacity of cluster
+*  @pre cluster can't point to NULL
+*  @pre capacity must be greater than one
+*/
+void init_cluster(struct cluster_t *c, int cap)
+{
+    assert(c != NULL);
+    assert(cap >= 0);
+
+    c->size = 0;
+    c->sx = c->sy = 0;
+    c->mx = c->my = 0;
+    c->capacity = CLUSTER_INLINE;
+    if (cap > CLUSTER_INLINE)
+    {
+        stats_add(mallocs, 1);
+        if ((c->store.heap = xmalloc(cap * sizeof(struct obj_t))))
+            c->capacity = cap;
+        else
+            fprintf(stderr, "Memory allocation was not succeed\n");
+    }
+}
+
+/**
+*  Erase all objects in cluster and initialize
+*  @ingroup cluster
+*  cluster to empty cluster
+*  @param c pointer to cluster
+*/
+void clear_cluster(struct cluster_t *c)
+{
+    if (c->capacity > CLUSTER_INLINE)
+        xfree(c->store.heap);
+    c->capacity = CLUSTER_INLINE;
+    c->size = 0;
+    c->sx = c->sy = 0;
+    c->mx = c->my = 0;
+}
+
+/// Chunk of cluster objects. Value recommended for reallocation.
+const int CLUSTER_CHUNK = 10;
+
+/**
+*  Change capacity of cluster, objects stored in cluster itself move to
+*  heap
+*  @ingroup cluster
+*  @param c pointer to cluster
+*  @param new_cap new capacity
+*  @pre cluster can't point to NULL
+*  @pre cluster capacity must be greater than one
+*  @pre new capacity must be greater than zero
+*  @return pointer to resized structure
+*/
+struct cluster_t *resize_cluster(struct cluster_t *c, int new_cap)
+{
+    assert(c);
+    assert(c->capacity >= CLUSTER_INLINE);
+    assert(new_cap >= 0);
+
+    if (c->capacity >= new_cap)
+        return c;
+
+    size_t size = sizeof(struct obj_t) * new_cap;
+    struct obj_t *arr;
+
+    if (c->capacity > CLUSTER_INLINE)
+    {
+        if ((arr = xrealloc(c->store.heap, size)) == NULL)
+            return NULL;
+        stats_add(reallocs, 1);
+    }
+    else
+    {
+        if ((arr = xmalloc(size)) == NULL)
+            return NULL;
+        stats_add(mallocs, 1);
+        memcpy(arr, c->store.small, sizeof(struct obj_t) * c->size);
+    }
+
+    c->store.heap = arr;
+    c->capacity = new_cap;
+    return c;
+}
+
+/**
+*  @ingroup cluster
+*  Appends object to cluster, in case of full capacity, resizes cluster
+*  @param c pointer to cluster
+*  @param obj object
+*/
+void append_cluster(struct cluster_t *c, struct obj_t obj)
+{
+    int cap = c->capacity;
+    int size = c->size;
+    while (size >= cap)
+        cap += CLUSTER_CHUNK;
+
+    if (resize_cluster(c, cap) == NULL)
+        return;
+    CLUSTER_OBJ(c)[c->size++] = obj;
+    c->sx += obj.x;
+    c->sy += obj.y;
+    c->mx = c->sx / c->size;
+    c->my = c->sy / c->size;
+}
+
+/**
+*  Copies objects of c2 to the end of c1. Objects are in order of merges,
+*  they are sorted by id only for output by sort_clusters.
+*  @ingroup cluster
+*  @param c1 pointer to cluster into which is appended
+*  @param c2 pointer to cluster which objects are appended
+*/
+static void append_objects(struct cluster_t *c1, struct cluster_t *c2)
+{
+    for (int i = 0; i < c2->size; i++)
+        append_cluster(c1, CLUSTER_OBJ(c2)[i]);
+}
+
+/**
+*  Merges objects of c2 sorted by id into objects of c1 sorted by id, from
+*  the end of c1, so objects of c1 are moved at most once. Objects of equal
+*  id of c1 stay before those of c2, like after stable sort.
+*  @ingroup cluster
+*  @param c1 pointer to cluster into which is merged
+*  @param c2 pointer to cluster which objects are merged
+*/
+static void merge_objects(struct cluster_t *c1, struct cluster_t *c2)
+{
+    int cap = c1->capacity;
+    int size = c1->size + c2->size;
+    while (size > cap)
+        cap += CLUSTER_CHUNK;
+
+    if (resize_cluster(c1, cap) == NULL)
+        return;
+
+    struct obj_t *o1 = CLUSTER_OBJ(c1);
+    struct obj_t *o2 = CLUSTER_OBJ(c2);
+    int i = c1->size - 1, j = c2->size - 1;
+
+    for (int k = size - 1; j >= 0; k--)
+        o1[k] = i >= 0 && o1[i].id > o2[j].id ? o1[i--] : o2[j--];
+    c1->size = size;
+}
+
+/**
+*  Moves objects of c2 into c1 and sets sums of merged cluster
+*  @ingroup cluster
+*  @param c1 pointer to cluster into which is appended
+*  @param c2 pointer to cluster which objects are appended
+*  @param sorted objects are merged by id instead of appended
+*/
+static void merge_into(struct cluster_t *c1, struct cluster_t *c2, int sorted)
+{
+    assert(c1 != NULL);
+    assert(c2 != NULL);
+
+    // sums follow the merges, not order of objects, so every engine which
+    // makes the same merges gets the same centroids
+    double sx = c1->sx + c2->sx, sy = c1->sy + c2->sy;
+    double mx = (c1->mx + c2->mx) / 2, my = (c1->my + c2->my) / 2;
+
+    stats_add(merge_bytes, c2->size * sizeof(struct obj_t));
+    if (sorted)
+        merge_objects(c1, c2);
+    else
+        append_objects(c1, c2);
+    c1->sx = sx;
+    c1->sy = sy;
+    c1->mx = mx;
+    c1->my = my;
+}
+
+/**
+*  Appends objects from one cluster to another, in case can be resized.
+*  Objects are in order of merges until sort_clusters sorts them by id.
+*  @ingroup cluster
+*  @param c1 pointer to cluster into which is appended
+*  @param c2 pointer to cluster which objects are appended
+*  @pre pointers c1 and c2 can't be NULL
+*/
+void merge_clusters(struct cluster_t *c1, struct cluster_t *c2)
+{
+    merge_into(c1, c2, 0);
+}
+
+/**
+*  Merges objects of two clusters sorted by id, so the merged cluster is
+*  sorted too. --avg sums distances in order of objects, which decides
+*  equal averages of the same merges in every engine.
+*  @ingroup cluster
+*  @param c1 pointer to cluster into which is merged
+*  @param c2 pointer to cluster which objects are merged
+*  @pre objects of both clusters are sorted by id
+*/
+void merge_clusters_sorted(struct cluster_t *c1, struct cluster_t *c2)
+{
+    merge_into(c1, c2, 1);
+}
+
+/**********************************************************************/
+/* Array operations */
+
+
+/**
+*  Removes cluster from array, clusters after it are moved down. Order of
+*  their objects is kept.
+*  @ingroup array
+*  @param carr array of clusters
+*  @param narr number of clusters in array
+*  @param idx index in array which is removed
+*  @pre index of object must be lower than number of clusters in array
+*  @pre number of clusters in array must be greater than zero
+*  @return size of cluster after remove
+*/
+int remove_cluster(struct cluster_t *carr, int narr, int idx)
+{
+    assert(idx < narr);
+    assert(narr > 0);
+
+    while (idx < narr) {
+
+        clear_cluster(&carr[idx]);
+
+        // if index is last in array, no need to merge
+        if(idx != narr - 1)
+        {
+            stats_add(remove_bytes, carr[idx + 1].size * sizeof(struct obj_t));
+            append_objects(&carr[idx], &carr[idx + 1]);
+            carr[idx].sx = carr[idx + 1].sx;
+            carr[idx].sy = carr[idx + 1].sy;
+            carr[idx].mx = carr[idx + 1].mx;
+            carr[idx].my = carr[idx + 1].my;
+        }
+
+        idx++;
+
+    }
+
+    return narr - 1;
+
+}
+
+/**
+*  Distance between two objects by metric, objects of more than two
+*  coordinates use kernel_metric_dim
+*  @ingroup cluster
+*  @param o1 pointer to object
+*  @param o2 pointer to object
+*  @param metric one of enum metric, a constant in loops
+*  @return distance between two objects
+*/
+__attribute__((always_inline))
+static inline float metric_distance(struct obj_t *o1, struct obj_t *o2, int metric)
+{
+    if (o1->dim > 2)
+        return kernel_metric_dim(o1->v, o2->v, o1->dim, metric);
+
+    return kernel_metric_xy(o1->x, o1->y, o2->x, o2->y, metric);
+}
+
+/**
+*  Distance between two objects by selected metric, Euclides distance
+*  unless --metric selects other
+*  @ingroup cluster
+*  @param o1 pointer to object
+*  @param o2 pointer to object
+*  @pre objects o1 and o2 can't point to NULL
+*  @pre objects have the same number of coordinates
+*  @return distance between two objects
+*/
+float obj_distance(struct obj_t *o1, struct obj_t *o2)
+{
+    assert(o1 != NULL);
+    assert(o2 != NULL);
+
+    return metric_distance(o1, o2, kernel_metric());
+}
+
+const char *const method_names[METHOD_COUNT] = { "avg", "min", "max", "ward", "centroid", "median" };
+
+/**
+*  Finds method by name
+*  @param name name of method without --
+*  @return method or -1 if name is unknown
+*/
+int method_by_name(const char *name)
+{
+    for (int i = 0; i < METHOD_COUNT; i++)
+        if (!strcmp(name, method_names[i]))
+            return i;
+    return -1;
+}
+
+/**
+*  Tells whether distance of method is computed from sizes, centroids and
+*  median points only, without objects
+*  @param method one of enum method
+*  @return nonzero for --ward, --centroid and --median
+*/
+int method_centroid(int method)
+{
+    return method == METHOD_WARD || method == METHOD_CENTROID || method == METHOD_MEDIAN;
+}
+
+/// Case value for choosing cluster distance method, one per thread so
+/// concurrent runs can use different methods
+__thread int premium_case;
+
+/**
+*  Ward distance, square root of twice the increase of sum of squares
+*  caused by merge, computed from sizes and centroids in O(1). For two
+*  objects it is their distance.
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @pre cluster size of cluster must be greater than zero
+*  @return distance between two clusters
+*/
+float ward_distance(struct cluster_t *c1, struct cluster_t *c2)
+{
+    double dx = c1->sx / c1->size - c2->sx / c2->size;
+    double dy = c1->sy / c1->size - c2->sy / c2->size;
+    double w = 2.0 * c1->size * c2->size / (c1->size + c2->size);
+
+    return sqrt(w * (dx * dx + dy * dy));
+}
+
+/**
+*  Distance of centroids in O(1)
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @pre cluster size of cluster must be greater than zero
+*  @return distance between two clusters
+*/
+float centroid_distance(struct cluster_t *c1, struct cluster_t *c2)
+{
+    double dx = c1->sx / c1->size - c2->sx / c2->size;
+    double dy = c1->sy / c1->size - c2->sy / c2->size;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+/**
+*  Distance of median points in O(1). Median point of merged cluster is the
+*  midpoint of median points of both clusters, whatever their sizes.
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @return distance between two clusters
+*/
+float median_distance(struct cluster_t *c1, struct cluster_t *c2)
+{
+    double dx = c1->mx - c2->mx;
+    double dy = c1->my - c2->my;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+/**
+*  Distance between two clusters from distances of their objects, compiled
+*  for every metric
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method METHOD_AVG, METHOD_MIN or METHOD_MAX
+*  @param metric one of enum metric, a constant in loops
+*  @return distance between two clusters
+*/
+__attribute__((always_inline))
+static inline float linkage_objects(struct cluster_t *c1, struct cluster_t *c2, int method, int metric)
+{
+    float result = 0;
+    struct obj_t *o1 = CLUSTER_OBJ(c1);
+    struct obj_t *o2 = CLUSTER_OBJ(c2);
+
+    if(method == METHOD_AVG)
+    {
+
+        float object_distance = 0;
+        int object_count = 0;
+
+        for (int i = 0; i < c1->size; i++)
+        {
+            for (int j = 0; j < c2->size; j++)
+            {
+                object_distance += metric_distance(&o1[i], &o2[j], metric);
+                object_count++;
+            }
+        }
+        result = object_distance / object_count;
+    }
+
+    if(method == METHOD_MIN)
+    {
+        float distance = metric_distance(&o1[0], &o2[0], metric);
+
+        for(int i = 0; i < c1->size; i++)
+        {
+            for(int j = 0; j < c2->size; j++)
+            {
+                float new_distance = metric_distance(&o1[i], &o2[j], metric);
+
+                if(distance > new_distance)
+                    distance = new_distance;
+            }
+        }
+        result = distance;
+    }
+
+    if(method == METHOD_MAX)
+    {
+        float distance = metric_distance(&o1[0], &o2[0], metric);
+
+        for(int i = 0; i < c1->size; i++)
+        {
+            for(int j = 0; j < c2->size; j++)
+            {
+                float new_distance = metric_distance(&o1[i], &o2[j], metric);
+
+                if(distance < new_distance)
+                    distance = new_distance;
+            }
+        }
+        result = distance;
+    }
+
+    return result;
+}
+
+/**
+*  Calculate distance between two clusters by given method
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method one of enum method
+*  @pre clusters c1 and c2 can't point to NULL
+*  @pre cluster size of cluster must be greater than zero
+*  @return distance between two clusters
+*/
+float linkage_distance(struct cluster_t *c1, struct cluster_t *c2, int method)
+{
+    assert(c1 != NULL);
+    assert(c1->size > 0);
+    assert(c2 != NULL);
+    assert(c2->size > 0);
+
+    if(method == METHOD_WARD)
+        return ward_distance(c1, c2);
+
+    if(method == METHOD_CENTROID)
+        return centroid_distance(c1, c2);
+
+    if(method == METHOD_MEDIAN)
+        return median_distance(c1, c2);
+
+    KERNEL_METRIC_CALL(kernel_metric(), return linkage_objects, c1, c2, method)
+    return 0;
+}
+
+/**
+*  Calculate distance between two clusters by selected method
+*  @ingroup cluster
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @pre clusters c1 and c2 can't point to NULL
+*  @pre cluster size of cluster must be greater than zero
+*  @return distance between two clusters
+*/
+float cluster_distance(struct cluster_t *c1, struct cluster_t *c2)
+{
+    stats_add(cluster_distance, 1);
+    stats_add(obj_distance, (unsigned long long)c1->size * c2->size);
+
+    return linkage_distance(c1, c2, premium_case);
+}
+
+/**
+*  Searching for two closest clusters in array
+*  and saves their indexes
+*  @ingroup array
+*  @param carr array of clusters
+*  @param narr count of clusters in array
+*  @param c1 pointer for saving first cluster
+*  @param c2 pointer for saving second cluster
+*  @pre number of clusters in array must be greater than zero
+*/
+void find_neighbours(struct cluster_t *carr, int narr, int *c1, int *c2)
+{
+    assert(narr > 0);
+    float distance, new_dist;
+    distance = cluster_distance(&carr[0], &carr[1]);
+
+    for (int i = 0; i < narr; i++) {
+        for (int j = i + 1; j < narr; j++)
+        {
+            new_dist = cluster_distance(&carr[i], &carr[j]);
+            if(distance >= new_dist)
+            {
+                distance = new_dist;
+                *c1 = i;
+                *c2 = j;
+            }
+        }
+    }
+}
+
+/**
+*  Function for easier sorting
+*  @ingroup cluster
+*  @param a pointer to void
+*  @param b pointer to void
+*  @return Zero if compare is succeed
+*/
+static int obj_sort_compar(const void *a, const void *b)
+{
+    const struct obj_t *o1 = (const struct obj_t *)a;
+    const struct obj_t *o2 = (const struct obj_t *)b;
+    if (o1->id < o2->id) return -1;
+    if (o1->id > o2->id) return 1;
+    return 0;
+}
+
+/// Clusters smaller than this are sorted by insertion instead of radix
+#define SORT_INSERTION 32
+
+/**
+*  Sorting cluster by id ASC. LSD radix sort by bytes of id, passes of a
+*  byte equal in all ids are skipped. Sort is stable, objects of equal id
+*  stay in order of merges.
+*  @ingroup cluster
+*  @param c pointer to cluster which is sorted
+*/
+void sort_cluster(struct cluster_t *c)
+{
+    struct obj_t *o = CLUSTER_OBJ(c);
+    int n = c->size;
+    int sorted = 1;
+
+    // clusters of --avg are kept sorted by merges
+    for (int i = 1; i < n && sorted; i++)
+        sorted = o[i - 1].id <= o[i].id;
+    if (sorted)
+        return;
+
+    if (n < SORT_INSERTION)
+    {
+        for (int i = 1; i < n; i++)
+        {
+            struct obj_t t = o[i];
+            int j = i;
+            for (; j > 0 && o[j - 1].id > t.id; j--)
+                o[j] = o[j - 1];
+            o[j] = t;
+        }
+        return;
+    }
+
+    struct obj_t *tmp = xmalloc(sizeof(struct obj_t) * n);
+    if (tmp == NULL)
+    {
+        qsort(o, n, sizeof(struct obj_t), &obj_sort_compar);
+        return;
+    }
+
+    // sign bit flipped, so negative ids are ordered before positive ones
+    int count[4][256] = { { 0 } };
+    for (int i = 0; i < n; i++)
+    {
+        unsigned key = (unsigned)o[i].id ^ 0x80000000u;
+        for (int b = 0; b < 4; b++)
+            count[b][(key >> 8 * b) & 255]++;
+    }
+
+    struct obj_t *src = o, *dst = tmp;
+    for (int b = 0; b < 4; b++)
+    {
+        unsigned first = (((unsigned)o[0].id ^ 0x80000000u) >> 8 * b) & 255;
+        if (count[b][first] == n)
+            continue;
+
+        int pos = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            int k = count[b][d];
+            count[b][d] = pos;
+            pos += k;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            unsigned key = (unsigned)src[i].id ^ 0x80000000u;
+            dst[count[b][(key >> 8 * b) & 255]++] = src[i];
+        }
+
+        struct obj_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != o)
+        memcpy(o, src, sizeof(struct obj_t) * n);
+    xfree(tmp);
+}
+
+/// Clusters sorted by workers of sort_clusters
+struct sort_pool {
+    struct cluster_t *carr;  ///< array of clusters
+    int narr;                ///< number of clusters
+    int next;                ///< next cluster to sort
+};
+
+/**
+*  Worker of sort_clusters, takes clusters until none is left
+*  @ingroup cluster
+*  @param arg pointer to struct sort_pool
+*  @return NULL
+*/
+static void *sort_worker(void *arg)
+{
+    struct sort_pool *pool = arg;
+    int pinned = numa_pin();
+    int i;
+
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->narr)
+        sort_cluster(&pool->carr[i]);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+/**
+*  Sorts objects of every cluster of array by id, clusters are sorted in
+*  parallel. Merges only append objects, output sorts them once.
+*  @ingroup cluster
+*  @param carr array of clusters
+*  @param narr number of clusters
+*  @param threads number of threads
+*/
+void sort_clusters(struct cluster_t *carr, int narr, int threads)
+{
+    struct sort_pool pool = { carr, narr, 0 };
+
+    if (threads > narr)
+        threads = narr;
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t tid[threads];
+    int started[threads];
+
+    for (int t = 1; t < threads; t++)
+        started[t] = !pthread_create(&tid[t], NULL, sort_worker, &pool);
+
+    // this thread sorts as well, workers which didn't start aren't needed
+    sort_worker(&pool);
+
+    for (int t = 1; t < threads; t++)
+        if (started[t])
+            pthread_join(tid[t], NULL);
+}
+
+/**
+*  Prints cluster to stdout
+*  @ingroup array
+*  @param c pointer to cluster which is printed
+*/
+void print_cluster(struct cluster_t *c)
+{
+    fprint_cluster(stdout, c);
+}
+
+/**
+*  Prints cluster to file
+*  @ingroup array
+*  @param f output file
+*  @param c pointer to cluster which is printed
+*/
+void fprint_cluster(FILE *f, struct cluster_t *c)
+{
+    struct obj_t *o = CLUSTER_OBJ(c);
+
+    for (int i = 0; i < c->size; i++)
+    {
+        if (i) putc(' ', f);
+        if (o[i].dim > 2)
+        {
+            fprintf(f, "%d[", o[i].id);
+            for (int k = 0; k < o[i].dim; k++)
+                fprintf(f, k ? ",%g" : "%g", o[i].v[k]);
+            putc(']', f);
+        }
+        else
+            fprintf(f, "%d[%g,%g]", o[i].id, o[i].x, o[i].y);
+    }
+    putc('\n', f);
+}
+
+/**
+*  Reports error of load_clusters, closes file and frees loaded clusters
+*  @ingroup array
+*  @param file opened file
+*  @param arr array of clusters or NULL
+*  @param loaded number of initialized clusters in array
+*  @param line line buffer
+*  @param coords block of coordinates or NULL
+*  @param msg error message
+*  @return zero, number of clusters after failed load
+*/
+static int load_failed(FILE *file, struct cluster_t *arr, int loaded, char *line, float *coords,
+                       const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    fclose(file);
+    free(line);
+    xfree(coords);
+
+    for (int i = 0; arr && i < loaded; i++)
+        clear_cluster(&arr[i]);
+    xfree(arr);
+
+    return 0;
+}
+
+/**
+*  Reads coordinates of object, text after its id
+*  @ingroup array
+*  @param s text of coordinates
+*  @param v array for coordinates or NULL to only count them
+*  @param dim capacity of v
+*  @return number of coordinates or -1 if text is invalid or v is full
+*/
+static int parse_coords(const char *s, float *v, int dim)
+{
+    int k = 0;
+    char *end;
+
+    for (;;)
+    {
+        while (isspace((unsigned char)*s))
+            s++;
+        if (!*s)
+            return k;
+
+        float f = strtof(s, &end);
+        if (end == s || !isfinite(f) || (v && k >= dim))
+            return -1;
+        if (v)
+            v[k] = f;
+        k++;
+        s = end;
+    }
+}
+
+/**
+*  Loads objects from file, for each object creates cluster and inserts
+*  it into an array of clusters. Also allocate space for array of Clusters
+*  and pointer on first item in array saves to memory. Number of coordinates
+*  is given by the first object, every object must have the same. Objects
+*  of two coordinates must lie in [0, 1000], coordinates of objects with
+*  more of them are in one block, v of the only object of the first
+*  cluster, which caller frees after the clusters.
+*  @ingroup array
+*  @param filename name of file from which are object loaded
+*  @param arr pointer on array of clusters
+*  @pre arr can't point to NULL
+*  @return number of clusters in file
+*/
+int load_clusters(char *filename, struct cluster_t **arr)
+{
+    assert(arr != NULL);
+    int lineNumber = 0;
+    FILE *file = fopen(filename, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int count = 0;
+    int dim = 0;
+    float *coords = NULL;
+    float xy[2];
+    struct obj_t object;
+
+    if(!file)
+    {
+        fprintf(stderr, "File not found\n");
+        return 0;
+    }
+
+    while (getline(&line, &cap, file) > 0)
+    {
+        if(lineNumber == 0)
+        {
+
+            if(sscanf(line, "count=%d", &count) == 0)
+                return load_failed(file, NULL, 0, line, NULL, "Invalid format for cluster count in file");
+
+            if(count < 1)
+                return load_failed(file, NULL, 0, line, NULL, "Invalid format or value for cluster count in file");
+
+            stats_add(mallocs, 1);
+            if(!(*arr = xmalloc(sizeof(struct cluster_t) * count)))
+                return load_failed(file, NULL, 0, line, NULL, "Memory allocation was not succeed");
+
+        }
+        else
+        {
+            if(lineNumber > count)
+                return load_failed(file, *arr, count, line, coords,
+                                   "Count of clusters is not equal as number in count paramteter");
+
+            init_cluster(&(*arr)[lineNumber - 1], 1);
+
+            char *rest;
+            long id = strtol(line, &rest, 10);
+            if(rest == line || id < INT_MIN || id > INT_MAX)
+                return load_failed(file, *arr, lineNumber, line, coords, "Data are invalid");
+
+            // first object tells number of coordinates
+            if(dim == 0)
+            {
+                dim = parse_coords(rest, NULL, 0);
+                if(dim < 2)
+                    return load_failed(file, *arr, lineNumber, line, coords, "Data are invalid");
+                if(dim > 2 && !(coords = xmalloc(sizeof(float) * dim * count)))
+                    return load_failed(file, *arr, lineNumber, line, coords, "Memory allocation was not succeed");
+            }
+
+            float *v = dim > 2 ? coords + (size_t)dim * (lineNumber - 1) : xy;
+            if(parse_coords(rest, v, dim) != dim)
+                return load_failed(file, *arr, lineNumber, line, coords, "Data are invalid");
+
+            if(dim == 2 && (0 > xy[1] || xy[1] > 1000 || 0 > xy[0] || xy[0] > 1000))
+                return load_failed(file, *arr, lineNumber, line, coords, "Data are invalid");
+
+            object.id = id;
+            object.x = v[0];
+            object.y = v[1];
+            object.dim = dim;
+            object.v = dim > 2 ? v : NULL;
+            append_cluster(&(*arr)[lineNumber - 1], object);
+        }
+        lineNumber++;
+    }
+
+    if(lineNumber != count + 1)
+        return load_failed(file, lineNumber ? *arr : NULL, lineNumber ? lineNumber - 1 : 0, line, coords,
+                           "Count of clusters is not equal as number in count paramteter");
+
+    free(line);
+    fclose(file);
+    return count;
+}
+
+/**
+*  Prints array of clusters to stdout
+*  @param carr array of clusters
+*  @param narr count of clusters in array
+*/
+void print_clusters(struct cluster_t *carr, int narr)
+{
+    fprint_clusters(stdout, carr, narr);
+}
+
+/**
+*  Prints array of clusters to file
+*  @param f output file
+*  @param carr array of clusters
+*  @param narr count of clusters in array
+*/
+void fprint_clusters(FILE *f, struct cluster_t *carr, int narr)
+{
+    fprintf(f, "Clusters:\n");
+    for (int i = 0; i < narr; i++)
+    {
+        fprintf(f, "cluster %d: ", i);
+        fprint_cluster(f, &carr[i]);
+    }
+}
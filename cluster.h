@@ -0,0 +1,118 @@
+/*
+*
+*  @brief     Simple cluster analysis
+*  @details   Objects, clusters and operations over them
+*  @author    Matej Soroka
+*  @date      12-13-2017
+*
+*/
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdio.h>
+
+///@defgroup array Array operations
+///@defgroup cluster Cluster operations
+
+#ifdef NDEBUG
+#define debug(s)
+#define dfmt(s, ...)
+#define dint(i)
+#define dfloat(f)
+#else
+
+/// prints debug string
+#define debug(s) printf("- %s\n", s)
+
+/// prints formated debug output (using similar like printf)
+#define dfmt(s, ...) printf(" - "__FILE__":%u: "s"\n",__LINE__,__VA_ARGS__)
+
+/// prints debug information about variable
+#define dint(i) printf(" - " __FILE__ ":%u: " #i " = %d\n", __LINE__, i)
+
+/// prints debug inforamtion about variable float type
+#define dfloat(f) printf(" - " __FILE__ ":%u: " #f " = %g\n", __LINE__, f)
+
+#endif
+
+/// @struct obj_t
+struct obj_t {
+    int id;  ///< unique ID of object
+    float x; ///< x coordinate of object, first coordinate
+    float y; ///< y coordinate of object, second coordinate
+    int dim; ///< number of coordinates, 2 or more
+    float *v;///< all dim coordinates if dim > 2, else NULL
+};
+
+/// Objects stored in cluster_t itself, clusters of up to three objects, i.e.
+/// singletons and results of the first merges, need no heap block. Each
+/// inline object adds 24 bytes, with three cluster_t is 112 bytes and still
+/// fits two cache lines, with four it would spill into a third
+#define CLUSTER_INLINE 3
+
+/// @struct cluster_t
+struct cluster_t {
+    int size;           ///< number of objects in cluster
+    int capacity;       ///< maximum number of objects in cluster, at least
+                        ///< CLUSTER_INLINE
+    union {
+        struct obj_t *heap;                  ///< objects if capacity is
+                                             ///< greater than CLUSTER_INLINE
+        struct obj_t small[CLUSTER_INLINE];  ///< objects otherwise
+    } store;            ///< array of objects, use CLUSTER_OBJ
+    double sx;          ///< sum of x of objects, centroid is sx / size
+    double sy;          ///< sum of y of objects, centroid is sy / size
+    double mx;          ///< x of median point, midpoint of merged clusters
+    double my;          ///< y of median point, midpoint of merged clusters
+};
+
+/// Array of objects of cluster, cluster_t may be copied and moved like any
+/// struct, so the array is found from capacity on every access
+#define CLUSTER_OBJ(c) ((c)->capacity > CLUSTER_INLINE ? (c)->store.heap : (c)->store.small)
+
+
+/// Cluster distance methods, values of premium_case
+enum method {
+    METHOD_AVG = 0, ///< unweighted pair-group average
+    METHOD_MIN = 1, ///< nearest neighbour
+    METHOD_MAX = 2, ///< furthest neighbour
+    METHOD_WARD = 3,///< increase of sum of squares, from centroids
+    METHOD_CENTROID = 4, ///< distance of centroids
+    METHOD_MEDIAN = 5,   ///< distance of median points
+    METHOD_COUNT
+};
+
+/// Names of methods, options are -- and name
+extern const char *const method_names[METHOD_COUNT];
+
+/// Case value for choosing cluster distance method (per thread)
+extern __thread int premium_case;
+
+/// Chunk of cluster objects. Value recommended for reallocation.
+extern const int CLUSTER_CHUNK;
+
+int method_by_name(const char *name);
+int method_centroid(int method);
+void init_cluster(struct cluster_t *c, int cap);
+void clear_cluster(struct cluster_t *c);
+struct cluster_t *resize_cluster(struct cluster_t *c, int new_cap);
+void append_cluster(struct cluster_t *c, struct obj_t obj);
+void merge_clusters(struct cluster_t *c1, struct cluster_t *c2);
+void merge_clusters_sorted(struct cluster_t *c1, struct cluster_t *c2);
+void sort_cluster(struct cluster_t *c);
+void sort_clusters(struct cluster_t *carr, int narr, int threads);
+int remove_cluster(struct cluster_t *carr, int narr, int idx);
+float obj_distance(struct obj_t *o1, struct obj_t *o2);
+float ward_distance(struct cluster_t *c1, struct cluster_t *c2);
+float centroid_distance(struct cluster_t *c1, struct cluster_t *c2);
+float median_distance(struct cluster_t *c1, struct cluster_t *c2);
+float linkage_distance(struct cluster_t *c1, struct cluster_t *c2, int method);
+float cluster_distance(struct cluster_t *c1, struct cluster_t *c2);
+void find_neighbours(struct cluster_t *carr, int narr, int *c1, int *c2);
+void print_cluster(struct cluster_t *c);
+int load_clusters(char *filename, struct cluster_t **arr);
+void print_clusters(struct cluster_t *carr, int narr);
+void fprint_cluster(FILE *f, struct cluster_t *c);
+void fprint_clusters(FILE *f, struct cluster_t *carr, int narr);
+
+#endif
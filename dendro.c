@@ -0,0 +1,227 @@
+/*
+*
+*  @brief     Dendrogram
+*  @details   Recorded sequence of merges and its cuts
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "dendro.h"
+
+int dendro_init(struct dendro *d, int n)
+{
+    d->n = n;
+    d->count = 0;
+    d->merges = xmalloc(sizeof(struct merge) * (n > 1 ? n - 1 : 1));
+    return d->merges != NULL;
+}
+
+void dendro_free(struct dendro *d)
+{
+    xfree(d->merges);
+    d->merges = NULL;
+    d->count = 0;
+}
+
+void dendro_add(struct dendro *d, int a, int b, float dist)
+{
+    if (d == NULL)
+        return;
+
+    d->merges[d->count].a = a;
+    d->merges[d->count].b = b;
+    d->merges[d->count].dist = dist;
+    d->count++;
+}
+
+void dendro_owners(const struct dendro *d, int narr, int *owner)
+{
+    int n = d->n;
+
+    // merged position points to the position it was merged into, which is
+    // always lower, so one pass in order of positions resolves all chains
+    for (int i = 0; i < n; i++)
+        owner[i] = i;
+    for (int m = 0; m < n - narr; m++)
+        owner[d->merges[m].b] = d->merges[m].a;
+    for (int i = 0; i < n; i++)
+        owner[i] = owner[owner[i]];
+}
+
+int dendro_cut(const struct dendro *d, const struct obj_t *obj, int narr, struct cluster_t **carr)
+{
+    int n = d->n;
+    int *owner = xmalloc(sizeof(int) * 2 * n);
+    if (owner == NULL)
+        return -1;
+    int *index = owner + n;
+
+    dendro_owners(d, narr, owner);
+
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        index[i] = owner[i] == i ? count++ : -1;
+
+    if ((*carr = xmalloc(sizeof(struct cluster_t) * count)) == NULL)
+    {
+        xfree(owner);
+        return -1;
+    }
+
+    // sizes first, so every cluster is allocated once
+    for (int i = 0; i < count; i++)
+        (*carr)[i].size = 0;
+    for (int i = 0; i < n; i++)
+        (*carr)[index[owner[i]]].size++;
+    for (int i = 0; i < count; i++)
+        init_cluster(&(*carr)[i], (*carr)[i].size);
+    for (int i = 0; i < n; i++)
+        append_cluster(&(*carr)[index[owner[i]]], obj[i]);
+    for (int i = 0; i < count; i++)
+        sort_cluster(&(*carr)[i]);
+
+    xfree(owner);
+    return count;
+}
+
+/**
+*  Compares keys of nodes of cut
+*  @ingroup dendro
+*  @param a first key
+*  @param b second key
+*  @return negative, zero or positive like strcmp
+*/
+static int layout_order_cmp(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+int dendro_layout_init(struct dendro_layout *l, const struct dendro *d, const struct obj_t *obj)
+{
+    int n = d->n, count = d->count, nodes = n + count;
+
+    l->n = n;
+    l->count = count;
+    l->leaf = xmalloc(sizeof(int) * ((size_t)4 * n + 3 * (size_t)count));
+    l->obj = xmalloc(sizeof(struct obj_t) * (n > 0 ? n : 1));
+    if (l->leaf == NULL || l->obj == NULL)
+    {
+        dendro_layout_free(l);
+        return 0;
+    }
+    l->start = l->leaf + n;
+    l->size = l->start + nodes;
+    l->child = l->size + nodes;
+    l->roots = l->child + 2 * count;
+
+    // leaf order holds node of every position until the traversal
+    int *cur = l->leaf;
+    for (int p = 0; p < n; p++)
+    {
+        cur[p] = p;
+        l->size[p] = 1;
+    }
+    for (int m = 0; m < count; m++)
+    {
+        int a = d->merges[m].a, b = d->merges[m].b;
+        l->child[2 * m] = cur[a];
+        l->child[2 * m + 1] = cur[b];
+        l->size[n + m] = l->size[cur[a]] + l->size[cur[b]];
+        cur[a] = n + m;
+        cur[b] = -1;
+    }
+
+    // roots follow each other, merges are split from the last one
+    int roots = 0, first = 0;
+    for (int p = 0; p < n; p++)
+        if (cur[p] >= 0)
+        {
+            l->roots[roots++] = cur[p];
+            l->start[cur[p]] = first;
+            first += l->size[cur[p]];
+        }
+    for (int m = count - 1; m >= 0; m--)
+    {
+        int left = l->child[2 * m], right = l->child[2 * m + 1];
+        l->start[left] = l->start[n + m];
+        l->start[right] = l->start[n + m] + l->size[left];
+    }
+
+    for (int p = 0; p < n; p++)
+    {
+        l->leaf[l->start[p]] = p;
+        l->obj[l->start[p]] = obj[p];
+    }
+    return 1;
+}
+
+void dendro_layout_free(struct dendro_layout *l)
+{
+    xfree(l->leaf);
+    xfree(l->obj);
+    l->leaf = NULL;
+    l->obj = NULL;
+}
+
+int dendro_layout_nodes(const struct dendro_layout *l, int narr, int *nodes)
+{
+    int n = l->n, k = n - narr;
+    int roots = n - l->count;
+    long long *order = xmalloc(sizeof(long long) * narr);
+    if (order == NULL)
+        return -1;
+
+    // nodes of merges after the cut are replaced by their two children
+    memcpy(nodes, l->roots, sizeof(int) * roots);
+    for (int i = 0, count = roots; i < count; )
+    {
+        int x = nodes[i];
+        if (x >= n && x - n >= k)
+        {
+            nodes[i] = l->child[2 * (x - n)];
+            nodes[count++] = l->child[2 * (x - n) + 1];
+        }
+        else
+            i++;
+    }
+
+    // lowest position is the first member, it is the key of the order
+    for (int i = 0; i < narr; i++)
+        order[i] = (long long)l->leaf[l->start[nodes[i]]] << 32 | nodes[i];
+    qsort(order, narr, sizeof(long long), layout_order_cmp);
+    for (int i = 0; i < narr; i++)
+        nodes[i] = (int)(order[i] & 0xffffffff);
+
+    xfree(order);
+    return 0;
+}
+
+int dendro_layout_cut(const struct dendro_layout *l, int narr, struct cluster_t **carr)
+{
+    int *nodes = xmalloc(sizeof(int) * narr);
+    if (nodes == NULL || dendro_layout_nodes(l, narr, nodes) < 0 ||
+        (*carr = xmalloc(sizeof(struct cluster_t) * narr)) == NULL)
+    {
+        xfree(nodes);
+        return -1;
+    }
+
+    for (int i = 0; i < narr; i++)
+    {
+        const struct obj_t *o = l->obj + l->start[nodes[i]];
+        int size = l->size[nodes[i]];
+
+        init_cluster(&(*carr)[i], size);
+        for (int j = 0; j < size; j++)
+            append_cluster(&(*carr)[i], o[j]);
+    }
+    sort_clusters(*carr, narr, 1);
+
+    xfree(nodes);
+    return narr;
+}
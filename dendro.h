@@ -0,0 +1,147 @@
+/*
+*
+*  @brief     Dendrogram
+*  @details   Recorded sequence of merges and its cuts
+*  @author    Matej Soroka
+*
+*/
+#ifndef DENDRO_H
+#define DENDRO_H
+
+#include "cluster.h"
+
+///@defgroup dendro Dendrogram
+
+/*
+ Engines merge greedily, so the first size - N merges of a run down to one
+ cluster are exactly the merges of a run down to N clusters. A dendrogram
+ recorded once answers every N by replaying a prefix of its merges.
+*/
+
+/// @struct merge
+struct merge {
+    int a;       ///< position of cluster which stays (lower position)
+    int b;       ///< position of cluster merged into a
+    float dist;  ///< cluster distance of merge
+};
+
+/// @struct dendro
+struct dendro {
+    int n;                 ///< number of objects (positions)
+    int count;             ///< number of recorded merges
+    struct merge *merges;  ///< merges in order of engine
+};
+
+/*
+ Layout numbers nodes of dendrogram: position p is leaf node p, merge m
+ makes node n + m of the nodes of positions a and b before it. Traversal
+ visits node of a first, so the first member of every node is its lowest
+ position and roots are in order of their lowest positions. A cut of any
+ N is then N ranges of leaf order, found from the roots by splitting nodes
+ of later merges, and members of a subtree are read without gathering.
+*/
+
+/// @struct dendro_layout
+struct dendro_layout {
+    int n;               ///< number of positions (leaves)
+    int count;           ///< number of merges, nodes are n + count
+    int *leaf;           ///< positions in leaf order
+    int *start;          ///< index in leaf order of first member of node
+    int *size;           ///< number of members of node
+    int *child;          ///< nodes merged by merge m at 2 * m and 2 * m + 1
+    int *roots;          ///< n - count roots in order of lowest position
+    struct obj_t *obj;   ///< objects in leaf order
+};
+
+/**
+*  Prepares empty dendrogram for n positions
+*  @ingroup dendro
+*  @param d dendrogram
+*  @param n number of positions
+*  @return nonzero if memory was allocated
+*/
+int dendro_init(struct dendro *d, int n);
+
+/**
+*  Frees memory of dendrogram
+*  @ingroup dendro
+*  @param d dendrogram
+*/
+void dendro_free(struct dendro *d);
+
+/**
+*  Appends merge of position b into position a
+*  @ingroup dendro
+*  @param d dendrogram or NULL
+*  @param a position of cluster which stays
+*  @param b position of removed cluster
+*  @param dist cluster distance of merge
+*/
+void dendro_add(struct dendro *d, int a, int b, float dist);
+
+/**
+*  Finds cluster of every position in cut with narr clusters
+*  @ingroup dendro
+*  @param d dendrogram
+*  @param narr requested number of clusters
+*  @param owner array for n lowest positions of clusters of positions
+*  @pre narr must be between n - count and n
+*/
+void dendro_owners(const struct dendro *d, int narr, int *owner);
+
+/**
+*  Builds clusters of cut with narr clusters. Clusters are ordered by their
+*  lowest position and objects by id, as engines leave them in array.
+*  @ingroup dendro
+*  @param d dendrogram
+*  @param obj objects in order of positions
+*  @param narr requested number of clusters
+*  @param carr pointer for new array of clusters
+*  @pre narr must be between n - count and n
+*  @return number of clusters or -1 if memory can't be allocated
+*/
+int dendro_cut(const struct dendro *d, const struct obj_t *obj, int narr, struct cluster_t **carr);
+
+/**
+*  Orders positions by traversal of dendrogram, so members of every node
+*  are one range of leaf order
+*  @ingroup dendro
+*  @param l layout
+*  @param d dendrogram
+*  @param obj objects in order of positions
+*  @return nonzero if memory was allocated
+*/
+int dendro_layout_init(struct dendro_layout *l, const struct dendro *d, const struct obj_t *obj);
+
+/**
+*  Frees memory of layout
+*  @ingroup dendro
+*  @param l layout
+*/
+void dendro_layout_free(struct dendro_layout *l);
+
+/**
+*  Finds nodes of cut with narr clusters in O(narr log narr), members of
+*  node x are positions leaf[start[x]] to leaf[start[x] + size[x] - 1]
+*  @ingroup dendro
+*  @param l layout
+*  @param narr requested number of clusters
+*  @param nodes array for narr nodes in order of their lowest position
+*  @pre narr must be between n - count and n
+*  @return zero or -1 if memory can't be allocated
+*/
+int dendro_layout_nodes(const struct dendro_layout *l, int narr, int *nodes);
+
+/**
+*  Builds clusters of cut with narr clusters like dendro_cut, every
+*  cluster is copied from one range of objects in leaf order
+*  @ingroup dendro
+*  @param l layout
+*  @param narr requested number of clusters
+*  @param carr pointer for new array of clusters
+*  @pre narr must be between n - count and n
+*  @return number of clusters or -1 if memory can't be allocated
+*/
+int dendro_layout_cut(const struct dendro_layout *l, int narr, struct cluster_t **carr);
+
+#endif
@@ -0,0 +1,456 @@
+/*
+*
+*  @brief     Divisive clustering
+*  @details   Top-down bisecting splits for small numbers of clusters
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "divisive.h"
+#include "kernel.h"
+#include "stats.h"
+
+/// @struct part
+/// Cluster made by splits, positions perm[start] to perm[end - 1]
+struct part {
+    int start;       ///< first index of perm
+    int end;         ///< end index of perm
+    double scatter;  ///< sum of distances of objects to centroid
+};
+
+/// @struct split
+/// Memory of splits, arrays of n items unless noted
+struct split {
+    struct cluster_t *carr;  ///< loaded singletons
+    int *perm;               ///< positions of objects, every part is a range
+    int *tmp;                ///< buffer for partitioning perm
+    char *side;              ///< half of every index of perm
+    float *d;                ///< 2 * n, distances to both centroids
+    double *sum;             ///< dim sums of coordinates
+    float *xs;               ///< x of packed range of 2-D objects
+    float *ys;               ///< y of packed range of 2-D objects
+    struct kernel_soa soa;   ///< packed range of objects of more dimensions
+    int packed;              ///< first index of perm of packed range
+    struct obj_t cent[2];    ///< centroids of halves
+    int n;                   ///< number of objects
+    int dim;                 ///< number of coordinates
+    int method;              ///< cluster distance method
+};
+
+/// @struct refine_cand
+/// Object near the boundary of split
+struct refine_cand {
+    float margin;   ///< difference of distances to both centroids
+    int k;          ///< index of perm
+};
+
+/**
+*  Object at index of perm
+*  @ingroup divisive
+*/
+static struct obj_t *split_obj(const struct split *s, int k)
+{
+    return &CLUSTER_OBJ(&s->carr[s->perm[k]])[0];
+}
+
+/**
+*  Coordinate of object
+*  @ingroup divisive
+*/
+static float obj_coord(const struct obj_t *o, int k)
+{
+    return o->dim > 2 ? o->v[k] : k ? o->y : o->x;
+}
+
+/**
+*  Sets coordinate of centroid
+*  @ingroup divisive
+*/
+static void cent_set(struct obj_t *c, int k, float f)
+{
+    if (c->dim > 2)
+        c->v[k] = f;
+    if (k < 2)
+        *(k ? &c->y : &c->x) = f;
+}
+
+/**
+*  Computes centroid of objects of range on side, or all objects
+*  @ingroup divisive
+*  @param s splits
+*  @param c centroid to set
+*  @param start first index of perm
+*  @param end end index of perm
+*  @param side side of objects or -1 for all
+*/
+static void split_centroid(struct split *s, int c, int start, int end, int side)
+{
+    int count = 0;
+
+    memset(s->sum, 0, sizeof(double) * s->dim);
+    for (int k = start; k < end; k++)
+    {
+        if (side >= 0 && s->side[k] != side)
+            continue;
+        struct obj_t *o = split_obj(s, k);
+        for (int l = 0; l < s->dim; l++)
+            s->sum[l] += obj_coord(o, l);
+        count++;
+    }
+
+    for (int l = 0; l < s->dim; l++)
+        cent_set(&s->cent[c], l, count ? s->sum[l] / count : 0);
+}
+
+/**
+*  Copies coordinates of objects of range for distance kernels
+*  @ingroup divisive
+*  @param s splits
+*  @param start first index of perm
+*  @param end end index of perm
+*  @return zero or -1 if memory can't be allocated
+*/
+static int split_pack(struct split *s, int start, int end)
+{
+    s->packed = start;
+    if (s->dim == 2)
+    {
+        for (int k = start; k < end; k++)
+        {
+            s->xs[k - start] = split_obj(s, k)->x;
+            s->ys[k - start] = split_obj(s, k)->y;
+        }
+        return 0;
+    }
+
+    kernel_soa_free(&s->soa);
+    if (!kernel_soa_alloc(&s->soa, end - start, s->dim))
+        return -1;
+    for (int k = start; k < end; k++)
+        kernel_soa_set(&s->soa, k - start, split_obj(s, k));
+    return 0;
+}
+
+/**
+*  Computes distances of objects of packed range to centroid
+*  @ingroup divisive
+*  @param s splits
+*  @param c centroid
+*  @param start first index of perm
+*  @param end end index of perm
+*  @return sum of distances
+*/
+static double split_distances(struct split *s, int c, int start, int end)
+{
+    double total = 0;
+    float *d = s->d + (size_t)c * s->n;
+    int first = start - s->packed;
+
+    if (s->dim == 2)
+        kernel_row(s->cent[c].x, s->cent[c].y, s->xs + first, s->ys + first, end - start, d + start);
+    else
+        kernel_soa_row(&s->cent[c], &s->soa, first, end - start, d + start);
+
+    for (int k = start; k < end; k++)
+        total += d[k];
+
+    stats_add(obj_distance, end - start);
+    return total;
+}
+
+/**
+*  Index of range with the greatest distance to centroid, the first of equal
+*  @ingroup divisive
+*/
+static int split_furthest(const struct split *s, int c, int start, int end)
+{
+    const float *d = s->d + (size_t)c * s->n;
+    int best = start;
+
+    for (int k = start + 1; k < end; k++)
+        if (d[k] > d[best])
+            best = k;
+    return best;
+}
+
+/**
+*  Compares candidates by margin, then by index
+*  @ingroup divisive
+*  @param a pointer to struct refine_cand
+*  @param b pointer to struct refine_cand
+*  @return negative, zero or positive value like strcmp
+*/
+static int refine_cand_compar(const void *a, const void *b)
+{
+    const struct refine_cand *c1 = a;
+    const struct refine_cand *c2 = b;
+    if (c1->margin != c2->margin)
+        return (c1->margin > c2->margin) - (c1->margin < c2->margin);
+    return c1->k - c2->k;
+}
+
+/**
+*  Moves objects nearest to the boundary to the half of lower linkage
+*  distance which also has their nearest object, one pass in order of margin
+*  @ingroup divisive
+*  @param s splits with sides and distances of packed range
+*  @param start first index of perm
+*  @param end end index of perm
+*  @return zero or -1 if memory can't be allocated
+*/
+static int split_refine(struct split *s, int start, int end)
+{
+    int m = end - start, n = s->n;
+    int count = m < DIVISIVE_REFINE ? m : DIVISIVE_REFINE;
+    struct refine_cand *cand = xmalloc(sizeof(struct refine_cand) * m);
+    if (cand == NULL)
+        return -1;
+
+    for (int k = start; k < end; k++)
+    {
+        float margin = s->d[k] - s->d[n + k];
+        cand[k - start].margin = margin < 0 ? -margin : margin;
+        cand[k - start].k = k;
+    }
+    qsort(cand, m, sizeof(struct refine_cand), refine_cand_compar);
+
+    // distances to centroids aren't needed any more, row of the object
+    // to all objects of range replaces them
+    float *row = s->d;
+    for (int i = 0; i < count; i++)
+    {
+        int k = cand[i].k, from = s->side[k];
+        struct obj_t *o = split_obj(s, k);
+
+        if (s->dim == 2)
+            kernel_row(o->x, o->y, s->xs, s->ys, m, row);
+        else
+            kernel_soa_row(o, &s->soa, 0, m, row);
+        stats_add(obj_distance, m);
+
+        // object isn't its own neighbour
+        double sum[2] = { 0, 0 };
+        float far[2] = { 0, 0 }, near[2] = { 0, 0 };
+        int size[2] = { 0, 0 };
+        for (int j = start; j < end; j++)
+        {
+            int c = s->side[j];
+            float d = row[j - start];
+            if (j == k)
+                continue;
+            if (!size[c] || near[c] > d)
+                near[c] = d;
+            if (!size[c] || far[c] < d)
+                far[c] = d;
+            sum[c] += d;
+            size[c]++;
+        }
+        if (!size[from])
+            continue;
+
+        // --avg and --max of a half depend on its far side too, the move
+        // must also bring the object to its nearest neighbour
+        float link[2];
+        for (int c = 0; c < 2; c++)
+            link[c] = s->method == METHOD_MIN ? near[c] : s->method == METHOD_MAX ? far[c] : sum[c] / size[c];
+        if (size[!from] && link[!from] < link[from] && near[!from] < near[from])
+            s->side[k] = !from;
+    }
+
+    xfree(cand);
+    return 0;
+}
+
+/**
+*  Splits part into two by 2-means and linkage refinement
+*  @ingroup divisive
+*  @param s splits
+*  @param p part to split, it becomes the first half
+*  @param q part for the second half
+*  @return zero or -1 if memory can't be allocated
+*/
+static int split_part(struct split *s, struct part *p, struct part *q)
+{
+    int start = p->start, end = p->end, m = end - start, n = s->n;
+
+    if (split_pack(s, start, end) < 0)
+        return -1;
+
+    // seeds are the object furthest from centroid and the one furthest
+    // from it, equal objects are split in halves of positions
+    split_centroid(s, 0, start, end, -1);
+    split_distances(s, 0, start, end);
+    int a = split_furthest(s, 0, start, end);
+    for (int l = 0; l < s->dim; l++)
+        cent_set(&s->cent[0], l, obj_coord(split_obj(s, a), l));
+    split_distances(s, 0, start, end);
+    int b = split_furthest(s, 0, start, end);
+
+    if (s->d[b] == 0)
+    {
+        for (int k = start; k < end; k++)
+            s->side[k] = k - start >= m / 2;
+    }
+    else
+    {
+        for (int l = 0; l < s->dim; l++)
+            cent_set(&s->cent[1], l, obj_coord(split_obj(s, b), l));
+        for (int k = start; k < end; k++)
+            s->side[k] = -1;
+
+        for (int it = 0; it < DIVISIVE_ITERATIONS; it++)
+        {
+            split_distances(s, 0, start, end);
+            split_distances(s, 1, start, end);
+
+            // a half must not become empty
+            int ones = 0, changed = 0;
+            for (int k = start; k < end; k++)
+                ones += s->d[n + k] < s->d[k];
+            if (ones == 0 || ones == m)
+                break;
+
+            for (int k = start; k < end; k++)
+            {
+                int side = s->d[n + k] < s->d[k];
+                changed += s->side[k] != side;
+                s->side[k] = side;
+            }
+            if (!changed)
+                break;
+
+            split_centroid(s, 0, start, end, 0);
+            split_centroid(s, 1, start, end, 1);
+        }
+
+        if (!method_centroid(s->method) && split_refine(s, start, end) < 0)
+            return -1;
+    }
+
+    // halves keep order of positions
+    int half = 0;
+    for (int k = start; k < end; k++)
+        if (!s->side[k])
+            s->tmp[half++] = s->perm[k];
+    for (int k = start, j = half; k < end; k++)
+        if (s->side[k])
+            s->tmp[j++] = s->perm[k];
+    memcpy(s->perm + start, s->tmp, sizeof(int) * m);
+
+    p->end = q->start = start + half;
+    q->end = end;
+
+    if (split_pack(s, start, end) < 0)
+        return -1;
+
+    struct part *h[2] = { p, q };
+    for (int c = 0; c < 2; c++)
+    {
+        split_centroid(s, 0, h[c]->start, h[c]->end, -1);
+        h[c]->scatter = split_distances(s, 0, h[c]->start, h[c]->end);
+    }
+    return 0;
+}
+
+int divisive_run(struct cluster_t *carr, int size, int narr, int method)
+{
+    struct split s;
+    struct part *parts = xmalloc(sizeof(struct part) * narr);
+    int dim = CLUSTER_OBJ(&carr[0])[0].dim;
+
+    s.carr = carr;
+    s.n = size;
+    s.dim = dim;
+    s.method = method;
+    s.perm = xmalloc(sizeof(int) * 2 * size);
+    s.side = xmalloc(size);
+    s.d = xmalloc(sizeof(float) * 2 * size);
+    s.sum = xmalloc(sizeof(double) * dim + sizeof(float) * 2 * dim);
+    s.xs = dim == 2 ? xmalloc(sizeof(float) * 2 * size) : NULL;
+    s.soa.c = NULL;
+
+    if (parts == NULL || s.perm == NULL || s.side == NULL || s.d == NULL || s.sum == NULL ||
+        (dim == 2 && s.xs == NULL))
+    {
+        xfree(parts);
+        xfree(s.perm);
+        xfree(s.side);
+        xfree(s.d);
+        xfree(s.sum);
+        xfree(s.xs);
+        return -1;
+    }
+    s.ys = dim == 2 ? s.xs + size : NULL;
+
+    s.tmp = s.perm + size;
+    for (int c = 0; c < 2; c++)
+    {
+        struct obj_t cent = { -1, 0, 0, dim, dim > 2 ? (float *)(s.sum + dim) + c * dim : NULL };
+        s.cent[c] = cent;
+    }
+
+    for (int i = 0; i < size; i++)
+        s.perm[i] = i;
+    parts[0].start = 0;
+    parts[0].end = size;
+    parts[0].scatter = 0;
+
+    // split the part of the largest scatter, of at least two objects
+    int count = 1, failed = 0;
+    while (count < narr && !failed)
+    {
+        int best = -1;
+        for (int i = 0; i < count; i++)
+            if (parts[i].end - parts[i].start > 1 && (best < 0 || parts[i].scatter > parts[best].scatter))
+                best = i;
+
+        failed = split_part(&s, &parts[best], &parts[count]) < 0;
+        count++;
+    }
+
+    if (!failed)
+    {
+        // objects go to the lowest position of their part, like merges of
+        // engines keep the lower position
+        int *host = s.tmp;
+        for (int i = 0; i < count; i++)
+        {
+            int low = s.perm[parts[i].start];
+            for (int k = parts[i].start; k < parts[i].end; k++)
+                if (s.perm[k] < low)
+                    low = s.perm[k];
+            for (int k = parts[i].start; k < parts[i].end; k++)
+                host[s.perm[k]] = low;
+        }
+
+        for (int i = 0; i < size; i++)
+            if (host[i] != i)
+            {
+                append_cluster(&carr[host[i]], CLUSTER_OBJ(&carr[i])[0]);
+                clear_cluster(&carr[i]);
+            }
+
+        int j = 0;
+        for (int i = 0; i < size; i++)
+            if (host[i] == i)
+            {
+                sort_cluster(&carr[i]);
+                carr[j] = carr[i];
+                if (j++ != i)
+                    init_cluster(&carr[i], 0);
+            }
+    }
+
+    xfree(parts);
+    xfree(s.perm);
+    xfree(s.side);
+    xfree(s.d);
+    xfree(s.sum);
+    xfree(s.xs);
+    kernel_soa_free(&s.soa);
+    return failed ? -1 : count;
+}
@@ -0,0 +1,60 @@
+/*
+*
+*  @brief     Divisive clustering
+*  @details   Top-down bisecting splits for small numbers of clusters
+*  @author    Matej Soroka
+*
+*/
+#ifndef DIVISIVE_H
+#define DIVISIVE_H
+
+#include "cluster.h"
+
+///@defgroup divisive Divisive clustering
+
+/*
+ Agglomeration makes n - N merges to reach N clusters, for N of 2 to 5 it
+ computes almost the whole hierarchy only to print its top. Divisive mode
+ starts from one cluster of all objects and splits the cluster of the
+ largest scatter until N clusters remain. Every split is 2-means in the
+ selected metric, started from the object furthest from the centroid and
+ the object furthest from it. Then DIVISIVE_REFINE objects of the smallest
+ difference of distances to both centroids are moved to the half of lower
+ linkage distance of the selected method, if their nearest object is in
+ that half too. The linkage is the nearest, furthest or mean distance of
+ one row of distances from the object to all objects of the cluster
+ (kernel_row or kernel_soa_row), no pair of clusters is compared (methods
+ computed from centroids are already decided by 2-means). A split costs O(m) distances for m
+ objects, so N clusters cost O(n * N).
+
+ Clusters are not the clusters of agglomeration, only their output format
+ is the same. Divisive splits are decided from the top, agglomerative
+ merges from the bottom, so they agree when the N groups are compact and
+ further apart than their diameters, e.g. separate blobs. Otherwise they
+ differ: --min of agglomeration follows chains of near objects, which
+ 2-means cuts through, and --max and --avg may cut a large group between
+ two small ones. --verify and --cache, which compare or store the
+ agglomerative hierarchy, are not supported.
+*/
+
+/// Objects nearest to the boundary of split moved by linkage distance
+#define DIVISIVE_REFINE 64
+
+/// Largest number of 2-means iterations of one split
+#define DIVISIVE_ITERATIONS 32
+
+/**
+*  Splits loaded singletons top-down into narr clusters. Clusters are in
+*  order of their lowest position and objects are sorted by id like
+*  clusters of engine_run.
+*  @ingroup divisive
+*  @param carr array of singletons
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param method cluster distance method refining splits
+*  @pre narr must be between one and size
+*  @return number of clusters in array or -1 if memory can't be allocated
+*/
+int divisive_run(struct cluster_t *carr, int size, int narr, int method);
+
+#endif
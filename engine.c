@@ -0,0 +1,1380 @@
+/*
+*
+*  @brief     Agglomeration engines
+*  @details   Reference loop and faster engines producing the same clusters
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "engine.h"
+#include "kernel.h"
+#include "stats.h"
+#include "trace.h"
+#include "progress.h"
+#include "numa.h"
+
+const char *const engine_names[ENGINE_COUNT] = { "ref", "matrix", "nnchain", "generic" };
+
+int engine_by_name(const char *name)
+{
+    for (int i = 0; i < ENGINE_COUNT; i++)
+        if (!strcmp(name, engine_names[i]))
+            return i;
+    return -1;
+}
+
+int engine_for_method(int engine, int method)
+{
+    int preferred = method == METHOD_WARD ? ENGINE_NNCHAIN :
+                    method_centroid(method) ? ENGINE_GENERIC : ENGINE_REF;
+
+    if (engine == ENGINE_REF || (engine == ENGINE_NNCHAIN && method != METHOD_WARD) ||
+        (engine == ENGINE_GENERIC && !method_centroid(method)))
+        return preferred;
+    return engine;
+}
+
+/**
+*  Writes sampled merge iteration and its phases to trace
+*  @ingroup engine
+*  @param iter number of iteration
+*  @param size number of clusters before merge
+*  @param c1 index of cluster into which was merged
+*  @param c2 index of removed cluster
+*  @param t times of start, end of neighbour search, merge and removal
+*/
+static void trace_iteration(long iter, int size, int c1, int c2, double t[4])
+{
+    char args[128];
+
+    if (!trace_keep(iter, t[3] - t[0]))
+        return;
+
+    snprintf(args, sizeof(args), "{\"iteration\":%ld,\"clusters\":%d,\"c1\":%d,\"c2\":%d}",
+             iter, size, c1, c2);
+    trace_span("iteration", "loop", t[0], t[3], args);
+    trace_span("neighbours", "phase", t[0], t[1], NULL);
+    trace_span("merge", "phase", t[1], t[2], NULL);
+    trace_span("remove", "phase", t[2], t[3], NULL);
+}
+
+/**
+*  Reference engine, searches all pairs of clusters in every iteration
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected method and dendrogram
+*  @return number of clusters in array or -1 if memory can't be allocated
+*/
+static int engine_reference(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts)
+{
+    int c1, c2;
+    long iter = 0;
+    double t[4];
+    int *pos = NULL;
+
+    premium_case = opts->method;
+
+    // dendrogram needs initial positions of clusters, which shift on removal
+    if (opts->dendro)
+    {
+        if ((pos = xmalloc(sizeof(int) * size)) == NULL)
+        {
+            fprintf(stderr, "Memory allocation was not succeed\n");
+            return -1;
+        }
+        for (int i = 0; i < size; i++)
+            pos[i] = i;
+    }
+
+    // every iteration evaluates all object pairs, cost doesn't fall with size
+    if (progressing)
+        progress_start(size, narr, 0);
+
+    while (size > narr)
+    {
+        if (tracing)
+            t[0] = stats_now();
+
+        stats_begin(PHASE_NEIGHBOURS);
+        find_neighbours(carr, size, &c1, &c2);
+        stats_end(PHASE_NEIGHBOURS);
+
+        if (tracing)
+            t[1] = stats_now();
+
+        if (pos)
+        {
+            dendro_add(opts->dendro, pos[c1], pos[c2],
+                       linkage_distance(&carr[c1], &carr[c2], opts->method));
+            memmove(pos + c2, pos + c2 + 1, sizeof(int) * (size - c2 - 1));
+        }
+
+        stats_begin(PHASE_MERGE);
+        if (opts->method == METHOD_AVG)
+            merge_clusters_sorted(&carr[c1], &carr[c2]);
+        else
+            merge_clusters(&carr[c1], &carr[c2]);
+        stats_end(PHASE_MERGE);
+
+        if (tracing)
+            t[2] = stats_now();
+
+        stats_begin(PHASE_REMOVE);
+        remove_cluster(carr, size, c2);
+        stats_end(PHASE_REMOVE);
+
+        if (tracing)
+        {
+            t[3] = stats_now();
+            trace_iteration(iter, size, c1, c2, t);
+        }
+
+        size--;
+        iter++;
+        progress_tick(size);
+    }
+
+    if (progressing)
+        progress_finish();
+
+    xfree(pos);
+    return size;
+}
+
+/**********************************************************************/
+/* Matrix engine */
+
+/*
+ Distances of all pairs of clusters are kept in condensed upper triangular
+ matrix indexed by position of cluster in the initial array. Merged cluster
+ stays at position of c1 and c2 is unlinked, so ordering of live positions
+ is the same as ordering of clusters in array of the reference loop.
+
+ Every row keeps its nearest neighbour among higher positions. The pair
+ picked is the minimum over rows, ties go to the higher row and in a row to
+ the higher column, which is the last pair find_neighbours accepts with >=.
+ Minimum and maximum are updated from the two merged rows (exact in float),
+ average is recomputed by kernel_linkage with the same argument order as
+ the reference, so distances are bit for bit the same.
+*/
+
+/// State of matrix engine
+struct matrix {
+    struct cluster_t *carr; ///< array of clusters
+    int n;                  ///< number of positions
+    int method;             ///< cluster distance method
+    float *dist;            ///< condensed matrix of distances
+    int *nn;                ///< nearest higher neighbour of row, -1 if none
+    float *nnd;             ///< distance to nearest neighbour
+    int *next;              ///< next live position, n at the end
+    int *prev;              ///< previous live position, -1 at the start
+    int head;               ///< first live position
+    float *xs;              ///< x of objects when all clusters are singletons
+    float *ys;              ///< y of objects when all clusters are singletons
+    struct kernel_soa soa;  ///< singletons of more dimensions, c is NULL if unused
+    const float *pre;       ///< precomputed distances of singletons or NULL
+    const int *index;       ///< objects of pre of singletons or NULL
+    int pre_n;              ///< number of objects of pre if index is set
+};
+
+/**
+*  Index of pair in condensed matrix
+*  @ingroup engine
+*  @param n number of positions
+*  @param i lower position
+*  @param j higher position
+*  @return index into matrix
+*/
+static inline size_t tri_index(size_t n, size_t i, size_t j)
+{
+    return i * (2 * n - i - 1) / 2 + (j - i - 1);
+}
+
+/**
+*  Finds nearest higher live neighbour of row
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param i row
+*/
+static void matrix_row_nn(struct matrix *m, int i)
+{
+    int best = -1;
+    float bestd = 0;
+
+    m->nn[i] = -1;
+    if (m->next[i] >= m->n)
+        return;
+
+    float *row = m->dist + tri_index(m->n, i, i + 1) - (i + 1);
+    for (int j = m->next[i]; j < m->n; j = m->next[j])
+    {
+        if (best < 0 || row[j] <= bestd)
+        {
+            bestd = row[j];
+            best = j;
+        }
+    }
+
+    m->nn[i] = best;
+    m->nnd[i] = bestd;
+}
+
+/**
+*  Copies row of singletons which are objects of precomputed matrix given
+*  by index, repeated objects get their obj_distance
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param i row
+*  @param row distances of row i to higher positions
+*/
+static void matrix_remap_row(struct matrix *m, int i, float *row)
+{
+    size_t a = m->index[i];
+
+    for (int j = i + 1; j < m->n; j++)
+    {
+        size_t b = m->index[j];
+        if (a == b)
+            row[j - i - 1] = obj_distance(&CLUSTER_OBJ(&m->carr[i])[0], &CLUSTER_OBJ(&m->carr[j])[0]);
+        else
+            row[j - i - 1] = m->pre[a < b ? tri_index(m->pre_n, a, b) : tri_index(m->pre_n, b, a)];
+    }
+}
+
+/// Arguments of build worker
+struct matrix_build {
+    struct matrix *m; ///< matrix engine state
+    int first;        ///< first row of worker
+    int last;         ///< rows of worker are below last
+    int step;         ///< rows of worker are first, first + step, ...
+};
+
+/**
+*  Fills rows of matrix and their nearest neighbours
+*  @ingroup engine
+*  @param arg pointer to struct matrix_build
+*  @return NULL
+*/
+static void *matrix_build_rows(void *arg)
+{
+    struct matrix_build *b = arg;
+    struct matrix *m = b->m;
+    double start = tracing ? stats_now() : 0;
+    int pinned = numa_pin();
+
+    // objects of more dimensions are computed in tiles of several rows
+    int rows = m->soa.c && !m->pre ? KERNEL_TILE_ROWS : 1;
+
+    for (int i = b->first; i < b->last; i += b->step)
+    {
+        int count = m->n - i < rows ? m->n - i : rows;
+        float *row = m->dist + tri_index(m->n, i, i + 1);
+        if (m->pre && m->index)
+            matrix_remap_row(m, i, row);
+        else if (m->pre)
+            memcpy(row, m->pre + tri_index(m->n, i, i + 1), sizeof(float) * (m->n - i - 1));
+        else if (m->soa.c)
+        {
+            float *out[KERNEL_TILE_ROWS];
+            for (int r = 0; r < count; r++)
+                out[r] = m->dist + tri_index(m->n, i + r, i + r + 1);
+            kernel_soa_rows(&m->soa, i, count, out);
+        }
+        else if (m->xs)
+            kernel_row(m->xs[i], m->ys[i], m->xs + i + 1, m->ys + i + 1, m->n - i - 1, row);
+        else
+            for (int j = i + 1; j < m->n; j++)
+                row[j - i - 1] = kernel_linkage(&m->carr[i], &m->carr[j], m->method);
+        for (int r = 0; m->nn && r < count; r++)
+            matrix_row_nn(m, i + r);
+    }
+
+    numa_unpin(pinned);
+    if (tracing)
+        trace_span("build rows", "engine", start, stats_now(), NULL);
+    return NULL;
+}
+
+/**
+*  Fills all rows, rows are interleaved between threads so every thread
+*  gets short and long rows of the triangle. Pinned threads take blocks of
+*  consecutive rows with equal number of pairs instead, so pages of a block
+*  are first written by its thread and placed on its node.
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param threads number of threads
+*/
+static void matrix_rows(struct matrix *m, int threads)
+{
+    if (threads > m->n)
+        threads = m->n;
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t tid[threads];
+    struct matrix_build arg[threads];
+    int started[threads];
+    int rows = m->soa.c && !m->pre ? KERNEL_TILE_ROWS : 1;
+    size_t pairs = (size_t)m->n * (m->n - 1) / 2, done = 0;
+    int row = 0;
+
+    for (int t = 0; t < threads; t++)
+    {
+        arg[t].m = m;
+        if (numa_pinning)
+        {
+            // block ends with the tile which reaches t + 1 shares of pairs
+            arg[t].first = row;
+            while (row < m->n && done < pairs / threads * (t + 1))
+                for (int r = 0; r < rows && row < m->n; r++)
+                    done += m->n - ++row;
+            arg[t].last = t == threads - 1 ? m->n : row;
+            arg[t].step = rows;
+        }
+        else
+        {
+            arg[t].first = t * rows;
+            arg[t].last = m->n;
+            arg[t].step = threads * rows;
+        }
+        started[t] = t > 0 && !pthread_create(&tid[t], NULL, matrix_build_rows, &arg[t]);
+    }
+
+    // rows of threads which could not be started are done by this thread
+    for (int t = 0; t < threads; t++)
+        if (!started[t])
+            matrix_build_rows(&arg[t]);
+
+    for (int t = 1; t < threads; t++)
+        if (started[t])
+            pthread_join(tid[t], NULL);
+}
+
+/**
+*  Computes all distances and nearest neighbours of rows
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param threads number of threads
+*/
+static void matrix_build(struct matrix *m, int threads)
+{
+    unsigned long long pairs = 0, objects = 0;
+
+    // distance of singletons is obj_distance for every method but those
+    // computed from centroids, whole rows are then computed by one SIMD row
+    // kernel call
+    int singletons = !method_centroid(m->method);
+    for (int i = 0; i < m->n && singletons; i++)
+        singletons = m->carr[i].size == 1;
+
+    m->soa.c = NULL;
+    if (!singletons)
+        m->pre = NULL;
+    else if (m->pre == NULL && m->n > 0 && CLUSTER_OBJ(&m->carr[0])[0].dim > 2)
+    {
+        if (kernel_soa_alloc(&m->soa, m->n, CLUSTER_OBJ(&m->carr[0])[0].dim))
+            for (int i = 0; i < m->n; i++)
+                kernel_soa_set(&m->soa, i, &CLUSTER_OBJ(&m->carr[i])[0]);
+    }
+    else if (m->pre == NULL && (m->xs = xmalloc(2 * sizeof(float) * m->n)))
+    {
+        m->ys = m->xs + m->n;
+        for (int i = 0; i < m->n; i++)
+        {
+            m->xs[i] = CLUSTER_OBJ(&m->carr[i])[0].x;
+            m->ys[i] = CLUSTER_OBJ(&m->carr[i])[0].y;
+        }
+    }
+
+    matrix_rows(m, threads);
+
+    for (int i = m->n - 1; i >= 0; i--)
+    {
+        pairs += m->carr[i].size * objects;
+        objects += m->carr[i].size;
+    }
+    xfree(m->xs);
+    m->xs = m->ys = NULL;
+    kernel_soa_free(&m->soa);
+
+    stats_add(cluster_distance, (unsigned long long)m->n * (m->n - 1) / 2);
+    if (!method_centroid(m->method))
+        stats_add(obj_distance, pairs);
+}
+
+/**
+*  Frees state of matrix engine unless it belongs to workspace
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param ws workspace or NULL
+*/
+static void matrix_free(struct matrix *m, struct engine_ws *ws)
+{
+    if (ws == NULL)
+        xfree(m->dist);
+}
+
+/**
+*  Allocates all arrays of matrix engine in one block, from workspace if
+*  it is given and large enough
+*  @ingroup engine
+*  @param m matrix engine state with n set
+*  @param ws workspace or NULL
+*  @return nonzero if memory was allocated
+*/
+static int matrix_alloc(struct matrix *m, struct engine_ws *ws)
+{
+    size_t pairs = (size_t)m->n * (m->n - 1) / 2;
+    size_t bytes = (pairs + 2 * (size_t)m->n) * sizeof(float) + 3 * (size_t)m->n * sizeof(int);
+    void *mem;
+
+    if (ws && ws->cap >= bytes)
+        mem = ws->mem;
+    else if (ws)
+    {
+        xfree(ws->mem);
+        ws->cap = 0;
+        if ((ws->mem = mem = xmalloc(bytes)))
+        {
+            ws->cap = bytes;
+            numa_advise(mem, bytes);
+        }
+    }
+    else if ((mem = xmalloc(bytes)))
+        numa_advise(mem, bytes);
+
+    if (mem == NULL)
+        return 0;
+
+    m->dist = mem;
+    m->nnd = m->dist + pairs;
+    m->nn = (int *)(m->nnd + m->n);
+    m->next = m->nn + m->n;
+    m->prev = m->next + m->n;
+    return 1;
+}
+
+float *distance_matrix(const struct obj_t *obj, int n, int threads)
+{
+    struct matrix m;
+    size_t pairs = (size_t)n * (n - 1) / 2;
+
+    memset(&m, 0, sizeof(m));
+    m.n = n;
+    if ((m.dist = xmalloc(sizeof(float) * (pairs ? pairs : 1))))
+        numa_advise(m.dist, sizeof(float) * pairs);
+    if (n > 0 && obj[0].dim > 2)
+    {
+        if (m.dist && kernel_soa_alloc(&m.soa, n, obj[0].dim))
+            for (int i = 0; i < n; i++)
+                kernel_soa_set(&m.soa, i, &obj[i]);
+    }
+    else
+        m.xs = xmalloc(2 * sizeof(float) * (n ? n : 1));
+    if (m.dist == NULL || (m.xs == NULL && m.soa.c == NULL))
+    {
+        xfree(m.dist);
+        xfree(m.xs);
+        return NULL;
+    }
+
+    m.ys = m.xs ? m.xs + n : NULL;
+    for (int i = 0; m.xs && i < n; i++)
+    {
+        m.xs[i] = obj[i].x;
+        m.ys[i] = obj[i].y;
+    }
+
+    matrix_rows(&m, threads);
+    xfree(m.xs);
+    kernel_soa_free(&m.soa);
+    return m.dist;
+}
+
+void engine_ws_free(struct engine_ws *ws)
+{
+    xfree(ws->mem);
+    ws->mem = NULL;
+    ws->cap = 0;
+}
+
+/**
+*  Updates row distances of merged cluster a after b was merged into it
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param a position of merged cluster
+*  @param b position of removed cluster
+*/
+static void matrix_update(struct matrix *m, int a, int b)
+{
+    size_t n = m->n;
+
+    for (int k = m->head; k < m->n; k = m->next[k])
+    {
+        if (k == a)
+            continue;
+
+        float *dak = &m->dist[k < a ? tri_index(n, k, a) : tri_index(n, a, k)];
+        float dbk = m->dist[k < b ? tri_index(n, k, b) : tri_index(n, b, k)];
+
+        if (m->method == METHOD_MIN)
+        {
+            if (dbk < *dak)
+                *dak = dbk;
+        }
+        else if (m->method == METHOD_MAX)
+        {
+            if (dbk > *dak)
+                *dak = dbk;
+        }
+        else
+        {
+            if (k < a)
+                *dak = kernel_linkage(&m->carr[k], &m->carr[a], m->method);
+            else
+                *dak = kernel_linkage(&m->carr[a], &m->carr[k], m->method);
+            stats_add(cluster_distance, 1);
+            if (m->method == METHOD_AVG)
+                stats_add(obj_distance, (unsigned long long)m->carr[a].size * m->carr[k].size);
+        }
+    }
+}
+
+/**
+*  Repairs nearest neighbours of rows after merge of b into a
+*  @ingroup engine
+*  @param m matrix engine state
+*  @param a position of merged cluster
+*  @param b position of removed cluster
+*/
+static void matrix_update_nn(struct matrix *m, int a, int b)
+{
+    for (int r = m->head; r < b && r < m->n; r = m->next[r])
+    {
+        if (r == a || m->nn[r] == a || m->nn[r] == b)
+            matrix_row_nn(m, r);
+        else if (r < a)
+        {
+            float d = m->dist[tri_index(m->n, r, a)];
+            if (d < m->nnd[r] || (d == m->nnd[r] && a > m->nn[r]))
+            {
+                m->nn[r] = a;
+                m->nnd[r] = d;
+            }
+        }
+    }
+}
+
+/**
+*  Matrix engine, O(n^2) memory and about O(n) work per merge for --min and
+*  --max, --avg additionally recomputes distances of merged cluster
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected method and threads
+*  @return number of clusters in array or -1 if memory can't be allocated
+*/
+static int engine_matrix(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts)
+{
+    struct matrix m;
+    long iter = 0;
+    double t[4];
+
+    m.carr = carr;
+    m.n = size;
+    m.method = opts->method;
+    m.head = 0;
+    m.xs = m.ys = NULL;
+    m.pre = opts->dist;
+    m.index = opts->index;
+    m.pre_n = opts->dist_n;
+
+    if (!matrix_alloc(&m, opts->ws))
+    {
+        fprintf(stderr, "Memory allocation was not succeed\n");
+        return -1;
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        m.next[i] = i + 1;
+        m.prev[i] = i - 1;
+    }
+
+    if (tracing)
+        t[0] = stats_now();
+    stats_begin(PHASE_BUILD);
+    matrix_build(&m, opts->threads > 0 ? opts->threads : 1);
+    stats_end(PHASE_BUILD);
+    if (tracing)
+        trace_span("build", "phase", t[0], stats_now(), NULL);
+
+    // merge scans live rows, cost falls linearly with number of clusters,
+    // --avg recomputes merged row over all objects, which doesn't fall
+    if (progressing)
+        progress_start(size, narr, opts->method == METHOD_AVG ? 0 : 1);
+
+    int live = size;
+    while (live > narr)
+    {
+        if (tracing)
+            t[0] = stats_now();
+
+        stats_begin(PHASE_NEIGHBOURS);
+        int a = -1;
+        for (int i = m.head; i < m.n; i = m.next[i])
+            if (m.nn[i] >= 0 && (a < 0 || m.nnd[i] <= m.nnd[a]))
+                a = i;
+        int b = m.nn[a];
+        stats_end(PHASE_NEIGHBOURS);
+
+        dendro_add(opts->dendro, a, b, m.nnd[a]);
+
+        if (tracing)
+            t[1] = stats_now();
+
+        stats_begin(PHASE_MERGE);
+        if (m.method == METHOD_AVG)
+            merge_clusters_sorted(&carr[a], &carr[b]);
+        else
+            merge_clusters(&carr[a], &carr[b]);
+        stats_end(PHASE_MERGE);
+
+        if (tracing)
+            t[2] = stats_now();
+
+        stats_begin(PHASE_REMOVE);
+        clear_cluster(&carr[b]);
+        if (m.prev[b] >= 0)
+            m.next[m.prev[b]] = m.next[b];
+        if (m.next[b] < m.n)
+            m.prev[m.next[b]] = m.prev[b];
+        stats_end(PHASE_REMOVE);
+
+        stats_begin(PHASE_MERGE);
+        matrix_update(&m, a, b);
+        stats_end(PHASE_MERGE);
+
+        stats_begin(PHASE_NEIGHBOURS);
+        matrix_update_nn(&m, a, b);
+        stats_end(PHASE_NEIGHBOURS);
+
+        if (tracing)
+        {
+            t[3] = stats_now();
+            trace_iteration(iter, live, a, b, t);
+        }
+
+        live--;
+        iter++;
+        progress_tick(live);
+    }
+
+    if (progressing)
+        progress_finish();
+
+    // live clusters are moved to the beginning in their order
+    int out = 0;
+    for (int i = m.head; i < m.n; i = m.next[i])
+        carr[out++] = carr[i];
+
+    matrix_free(&m, opts->ws);
+    return out;
+}
+
+/**********************************************************************/
+/* Nearest neighbour chain engine */
+
+/*
+ Ward linkage is reducible: merged cluster is never closer to a third one
+ than the nearer of the two merged clusters was. A chain of nearest
+ neighbours started anywhere ends in reciprocal nearest neighbours, which
+ are merged at once, and merges sorted by distance are the merges of the
+ reference loop. Of equally distant pairs the loop merges the last one in
+ order of find_neighbours, the pair of highest lower position and then of
+ highest higher position. Pairs are ordered the same way by the chain and
+ by the sort, a merged cluster stays at the lower position, so its equally
+ distant pairs only come later in that order and the linkage stays
+ reducible with ties too. Clusters of the chain are sizes and sums of
+ coordinates only, so time is O(n^2) and memory O(n). Merges up to narr
+ clusters are then applied to the array.
+*/
+
+/// Merge found by chain
+struct chain_merge {
+    int a;       ///< lower position, stays
+    int b;       ///< higher position, merged into a
+    float dist;  ///< distance of merge
+    int order;   ///< number of merge in chain order
+};
+
+/**
+*  Decides whether pair is merged before another one by the reference loop,
+*  pairs of equal distance are taken from the last one in order of
+*  find_neighbours
+*  @ingroup engine
+*  @param d distance of first pair
+*  @param a lower position of first pair
+*  @param b higher position of first pair
+*  @param e distance of second pair
+*  @param c lower position of second pair
+*  @param f higher position of second pair
+*  @return nonzero if first pair comes first
+*/
+static int chain_before(float d, int a, int b, float e, int c, int f)
+{
+    if (d != e)
+        return d < e;
+    return a != c ? a > c : b > f;
+}
+
+/**
+*  Compares merges in order of the reference loop
+*  @ingroup engine
+*  @param a first merge
+*  @param b second merge
+*  @return negative if a comes first
+*/
+static int chain_merge_cmp(const void *a, const void *b)
+{
+    const struct chain_merge *ma = a, *mb = b;
+
+    if (chain_before(ma->dist, ma->a, ma->b, mb->dist, mb->a, mb->b))
+        return -1;
+    if (chain_before(mb->dist, mb->a, mb->b, ma->dist, ma->a, ma->b))
+        return 1;
+    return ma->order - mb->order;
+}
+
+/**
+*  Nearest neighbour chain engine for --ward
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected method and dendrogram
+*  @return number of clusters in array or -1 on error
+*/
+static int engine_nnchain(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts)
+{
+    if (opts->method != METHOD_WARD)
+    {
+        fprintf(stderr, "Engine nnchain supports only --ward\n");
+        return -1;
+    }
+
+    struct cluster_t *m = xmalloc(sizeof(struct cluster_t) * size);
+    struct chain_merge *merges = xmalloc(sizeof(struct chain_merge) * (size > 1 ? size - 1 : 1));
+    int *chain = xmalloc(sizeof(int) * 3 * size);
+
+    if (m == NULL || merges == NULL || chain == NULL)
+    {
+        xfree(m);
+        xfree(merges);
+        xfree(chain);
+        fprintf(stderr, "Memory allocation was not succeed\n");
+        return -1;
+    }
+
+    int *next = chain + size;
+    int *prev = next + size;
+    int head = 0, len = 0, count = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        m[i].size = carr[i].size;
+        m[i].sx = carr[i].sx;
+        m[i].sy = carr[i].sy;
+        m[i].mx = carr[i].mx;
+        m[i].my = carr[i].my;
+        next[i] = i + 1;
+        prev[i] = i - 1;
+    }
+
+    if (progressing)
+        progress_start(size, 1, 1);
+
+    stats_begin(PHASE_NEIGHBOURS);
+    while (count < size - 1)
+    {
+        if (len == 0)
+            chain[len++] = head;
+
+        // pairs are strictly ordered, so the chain always ends
+        int a = chain[len - 1], p = len > 1 ? chain[len - 2] : -1, b = -1;
+        float bd = 0;
+        for (int c = head; c < size; c = next[c])
+        {
+            if (c == a)
+                continue;
+            float d = ward_distance(&m[a], &m[c]);
+            if (b < 0 || chain_before(d, a < c ? a : c, a < c ? c : a, bd, a < b ? a : b, a < b ? b : a))
+            {
+                b = c;
+                bd = d;
+            }
+        }
+        stats_add(cluster_distance, size - count - 1);
+
+        if (b != p)
+        {
+            chain[len++] = b;
+            continue;
+        }
+
+        len -= 2;
+        if (a > b)
+        {
+            int t = a;
+            a = b;
+            b = t;
+        }
+        merges[count] = (struct chain_merge){ a, b, bd, count };
+        count++;
+
+        m[a].size += m[b].size;
+        m[a].sx += m[b].sx;
+        m[a].sy += m[b].sy;
+        if (prev[b] >= 0)
+            next[prev[b]] = next[b];
+        else
+            head = next[b];
+        if (next[b] < size)
+            prev[next[b]] = prev[b];
+
+        progress_tick(size - count);
+    }
+    stats_end(PHASE_NEIGHBOURS);
+
+    if (progressing)
+        progress_finish();
+
+    qsort(merges, count, sizeof(struct chain_merge), chain_merge_cmp);
+
+    for (int i = 0; i < count; i++)
+        dendro_add(opts->dendro, merges[i].a, merges[i].b, merges[i].dist);
+
+    stats_begin(PHASE_MERGE);
+    for (int i = 0; i < size - narr; i++)
+    {
+        merge_clusters(&carr[merges[i].a], &carr[merges[i].b]);
+        clear_cluster(&carr[merges[i].b]);
+    }
+    stats_end(PHASE_MERGE);
+
+    // merged clusters were cleared, live ones move to the front in order
+    int out = 0;
+    for (int i = 0; i < size; i++)
+        if (carr[i].size > 0)
+            carr[out++] = carr[i];
+
+    xfree(m);
+    xfree(merges);
+    xfree(chain);
+    return out;
+}
+
+/**********************************************************************/
+/* Generic engine */
+
+/*
+ --centroid and --median are not reducible, a merged cluster can be closer
+ to a third cluster than both merged clusters were, so merge distances are
+ not monotonic and nearest neighbour chains don't apply. Every row keeps its
+ nearest neighbour among higher positions in a heap ordered by distance.
+ A merge changes only distances of the merged row, rows whose neighbour was
+ merged get a lower bound of their distance and are searched again only
+ when they reach the top of heap (Muellner's generic algorithm). Distances
+ are O(1) from sizes, centroids and median points, so memory is O(n).
+ Equal distances are ordered by higher position, so merges are the same as
+ of the reference loop.
+*/
+
+/// State of generic engine
+struct generic {
+    int n;                 ///< number of positions
+    int method;            ///< cluster distance method
+    struct cluster_t *c;   ///< sizes, sums and median points of positions
+    int head;              ///< first live position
+    int *next;             ///< next live position, n at the end
+    int *prev;             ///< previous live position, -1 at the beginning
+    int *nn;               ///< nearest neighbour among higher positions
+    char *dirty;           ///< nonzero if key is only a lower bound
+    float *key;            ///< distance to nn or its lower bound
+    int *heap;             ///< binary heap of positions
+    int *at;               ///< index of position in heap or -1
+    int len;               ///< number of positions in heap
+};
+
+/**
+*  Compares heap entries, lower key first, equal keys higher position first
+*  @ingroup engine
+*  @param g generic engine state
+*  @param i position
+*  @param j position
+*  @return nonzero if i comes before j
+*/
+static int generic_before(const struct generic *g, int i, int j)
+{
+    return g->key[i] < g->key[j] || (g->key[i] == g->key[j] && i > j);
+}
+
+/**
+*  Moves heap entry up or down to its place
+*  @ingroup engine
+*  @param g generic engine state
+*  @param k index in heap
+*/
+static void generic_sift(struct generic *g, int k)
+{
+    int p = g->heap[k];
+
+    while (k > 0 && generic_before(g, p, g->heap[(k - 1) / 2]))
+    {
+        g->heap[k] = g->heap[(k - 1) / 2];
+        g->at[g->heap[k]] = k;
+        k = (k - 1) / 2;
+    }
+    for (int c; (c = 2 * k + 1) < g->len; k = c)
+    {
+        if (c + 1 < g->len && generic_before(g, g->heap[c + 1], g->heap[c]))
+            c++;
+        if (!generic_before(g, g->heap[c], p))
+            break;
+        g->heap[k] = g->heap[c];
+        g->at[g->heap[k]] = k;
+    }
+    g->heap[k] = p;
+    g->at[p] = k;
+}
+
+/**
+*  Sets key of position, inserts it into heap if it isn't there
+*  @ingroup engine
+*  @param g generic engine state
+*  @param i position
+*  @param key new key
+*/
+static void generic_set(struct generic *g, int i, float key)
+{
+    g->key[i] = key;
+    if (g->at[i] < 0)
+    {
+        g->heap[g->len] = i;
+        g->at[i] = g->len++;
+    }
+    generic_sift(g, g->at[i]);
+}
+
+/**
+*  Removes position from heap if it is there
+*  @ingroup engine
+*  @param g generic engine state
+*  @param i position
+*/
+static void generic_remove(struct generic *g, int i)
+{
+    int k = g->at[i];
+
+    if (k < 0)
+        return;
+    g->at[i] = -1;
+    if (k == --g->len)
+        return;
+    g->heap[k] = g->heap[g->len];
+    g->at[g->heap[k]] = k;
+    generic_sift(g, k);
+}
+
+/**
+*  Searches nearest neighbour of row among higher live positions, equal
+*  distances by higher position
+*  @ingroup engine
+*  @param g generic engine state
+*  @param i position
+*/
+static void generic_row(struct generic *g, int i)
+{
+    int best = -1, count = 0;
+    float bd = 0;
+
+    for (int j = g->next[i]; j < g->n; j = g->next[j])
+    {
+        float d = linkage_distance(&g->c[i], &g->c[j], g->method);
+        if (best < 0 || d <= bd)
+        {
+            best = j;
+            bd = d;
+        }
+        count++;
+    }
+    stats_add(cluster_distance, count);
+
+    g->nn[i] = best;
+    g->dirty[i] = 0;
+    if (best < 0)
+        generic_remove(g, i);
+    else
+        generic_set(g, i, bd);
+}
+
+/**
+*  Updates rows after merge of b into a
+*  @ingroup engine
+*  @param g generic engine state
+*  @param a position of merged cluster
+*  @param b position of removed cluster
+*/
+static void generic_update(struct generic *g, int a, int b)
+{
+    // rows before a change only by their distance to a, old key stays a
+    // lower bound of the others
+    int count = 0;
+    for (int r = g->head; r < a; r = g->next[r], count++)
+    {
+        float d = linkage_distance(&g->c[r], &g->c[a], g->method);
+        float key = g->key[r];
+
+        if (g->dirty[r])
+            key = d < key ? d : key;
+        else if (d < key || (d == key && a >= g->nn[r]))
+        {
+            // a is the nearest, an equal key of a lower neighbour loses
+            g->nn[r] = a;
+            key = d;
+        }
+        else if (g->nn[r] == a || g->nn[r] == b)
+            g->dirty[r] = 1;
+        else
+            continue;
+        generic_set(g, r, key);
+    }
+    stats_add(cluster_distance, count);
+
+    generic_row(g, a);
+
+    // rows between a and b lost their neighbour b, other distances stay
+    for (int r = g->next[a]; r < b; r = g->next[r])
+        if (g->nn[r] == b)
+            g->dirty[r] = 1;
+}
+
+/**
+*  Generic engine for methods computed from centroids
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected method and dendrogram
+*  @return number of clusters in array or -1 on error
+*/
+static int engine_generic(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts)
+{
+    if (!method_centroid(opts->method))
+    {
+        fprintf(stderr, "Engine generic supports only --ward, --centroid and --median\n");
+        return -1;
+    }
+
+    struct generic g;
+    struct chain_merge *merges = xmalloc(sizeof(struct chain_merge) * (size > 1 ? size - 1 : 1));
+    int *mem = xmalloc(sizeof(int) * 5 * size);
+
+    g.n = size;
+    g.method = opts->method;
+    g.c = xmalloc(sizeof(struct cluster_t) * size);
+    g.key = xmalloc(sizeof(float) * size);
+    g.dirty = xmalloc(size);
+
+    if (merges == NULL || mem == NULL || g.c == NULL || g.key == NULL || g.dirty == NULL)
+    {
+        xfree(merges);
+        xfree(mem);
+        xfree(g.c);
+        xfree(g.key);
+        xfree(g.dirty);
+        fprintf(stderr, "Memory allocation was not succeed\n");
+        return -1;
+    }
+
+    g.next = mem;
+    g.prev = mem + size;
+    g.nn = mem + 2 * size;
+    g.heap = mem + 3 * size;
+    g.at = mem + 4 * size;
+    g.head = 0;
+    g.len = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        g.c[i].size = carr[i].size;
+        g.c[i].sx = carr[i].sx;
+        g.c[i].sy = carr[i].sy;
+        g.c[i].mx = carr[i].mx;
+        g.c[i].my = carr[i].my;
+        g.next[i] = i + 1;
+        g.prev[i] = i - 1;
+        g.at[i] = -1;
+    }
+
+    // without dendrogram merges below narr are not needed
+    int stop = opts->dendro ? 1 : narr, count = 0;
+
+    if (progressing)
+        progress_start(size, stop, 1);
+
+    stats_begin(PHASE_BUILD);
+    for (int i = 0; i < size; i++)
+        generic_row(&g, i);
+    stats_end(PHASE_BUILD);
+
+    stats_begin(PHASE_NEIGHBOURS);
+    while (size - count > stop)
+    {
+        int a = g.heap[0];
+        if (g.dirty[a])
+        {
+            generic_row(&g, a);
+            continue;
+        }
+
+        int b = g.nn[a];
+        merges[count] = (struct chain_merge){ a, b, g.key[a], count };
+        count++;
+
+        // the same sums as merge_clusters computes for the array
+        g.c[a].size += g.c[b].size;
+        g.c[a].sx += g.c[b].sx;
+        g.c[a].sy += g.c[b].sy;
+        g.c[a].mx = (g.c[a].mx + g.c[b].mx) / 2;
+        g.c[a].my = (g.c[a].my + g.c[b].my) / 2;
+
+        if (g.prev[b] >= 0)
+            g.next[g.prev[b]] = g.next[b];
+        else
+            g.head = g.next[b];
+        if (g.next[b] < size)
+            g.prev[g.next[b]] = g.prev[b];
+        generic_remove(&g, b);
+
+        generic_update(&g, a, b);
+        progress_tick(size - count);
+    }
+    stats_end(PHASE_NEIGHBOURS);
+
+    if (progressing)
+        progress_finish();
+
+    for (int i = 0; i < count; i++)
+        dendro_add(opts->dendro, merges[i].a, merges[i].b, merges[i].dist);
+
+    stats_begin(PHASE_MERGE);
+    for (int i = 0; i < size - narr; i++)
+    {
+        merge_clusters(&carr[merges[i].a], &carr[merges[i].b]);
+        clear_cluster(&carr[merges[i].b]);
+    }
+    stats_end(PHASE_MERGE);
+
+    int out = 0;
+    for (int i = 0; i < size; i++)
+        if (carr[i].size > 0)
+            carr[out++] = carr[i];
+
+    xfree(merges);
+    xfree(mem);
+    xfree(g.c);
+    xfree(g.key);
+    xfree(g.dirty);
+    return out;
+}
+
+const char *engine_unsupported(const struct obj_t *obj, int method)
+{
+    if (!method_centroid(method))
+        return NULL;
+
+    // clusters keep sums of the first two coordinates only
+    if (obj->dim > 2)
+        return "method supports only 2-D objects";
+
+    // centroids and sums of squares are defined in Euclidean space
+    if (kernel_metric() != METRIC_EUCLIDEAN)
+        return "method supports only euclidean metric";
+
+    return NULL;
+}
+
+int engine_run(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts)
+{
+    const char *unsupported = size > 0 ? engine_unsupported(&CLUSTER_OBJ(&carr[0])[0], opts->method) : NULL;
+    if (unsupported)
+    {
+        fprintf(stderr, "--%s: %s\n", method_names[opts->method], unsupported);
+        return -1;
+    }
+
+    int count;
+    if (opts->engine == ENGINE_MATRIX)
+        count = engine_matrix(carr, size, narr, opts);
+    else if (opts->engine == ENGINE_NNCHAIN)
+        count = engine_nnchain(carr, size, narr, opts);
+    else if (opts->engine == ENGINE_GENERIC)
+        count = engine_generic(carr, size, narr, opts);
+    else
+        count = engine_reference(carr, size, narr, opts);
+
+    // merges keep objects in order of merges, output is sorted by id
+    if (count > 0)
+        sort_clusters(carr, count, opts->threads);
+    return count;
+}
+
+/// Run of one method of engine_run_methods
+struct method_run {
+    struct cluster_t *carr;   ///< own copy of clusters
+    int size;                 ///< number of clusters in copy
+    int narr;                 ///< requested number of clusters
+    struct engine_opts opts;  ///< options with method of run
+    int count;                ///< result of engine_run
+};
+
+/**
+*  Thread running one method
+*  @ingroup engine
+*  @param arg pointer to struct method_run
+*  @return NULL
+*/
+static void *method_thread(void *arg)
+{
+    struct method_run *r = arg;
+    int pinned = numa_pin();
+
+    r->count = engine_run(r->carr, r->size, r->narr, &r->opts);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+int engine_run_methods(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts,
+                       int methods, struct cluster_t *out[METHOD_COUNT], int count[METHOD_COUNT])
+{
+    struct method_run run[METHOD_COUNT];
+    pthread_t tid[METHOD_COUNT];
+    int started[METHOD_COUNT] = { 0 };
+    float *dist = NULL;
+    int failed = 0;
+
+    // distances of singletons are the same for every method
+    int singletons = opts->engine == ENGINE_MATRIX && opts->dist == NULL;
+    for (int i = 0; i < size && singletons; i++)
+        singletons = carr[i].size == 1;
+
+    if (singletons)
+    {
+        struct obj_t *obj = xmalloc(sizeof(struct obj_t) * size);
+        if (obj)
+        {
+            for (int i = 0; i < size; i++)
+                obj[i] = CLUSTER_OBJ(&carr[i])[0];
+            dist = distance_matrix(obj, size, opts->threads);
+            xfree(obj);
+        }
+    }
+
+    for (int m = 0; m < METHOD_COUNT; m++)
+    {
+        out[m] = NULL;
+        count[m] = 0;
+        if (!(methods & 1 << m))
+            continue;
+
+        run[m].carr = copy_clusters(carr, size);
+        run[m].size = size;
+        run[m].narr = narr;
+        run[m].opts = *opts;
+        run[m].opts.method = m;
+        run[m].opts.engine = engine_for_method(opts->engine, m);
+        run[m].opts.ws = NULL;
+        run[m].opts.dendro = NULL;
+        if (dist)
+            run[m].opts.dist = dist;
+        run[m].count = -1;
+
+        if (run[m].carr == NULL)
+            failed = 1;
+        else if (!(started[m] = !pthread_create(&tid[m], NULL, method_thread, &run[m])))
+            method_thread(&run[m]);
+    }
+
+    for (int m = 0; m < METHOD_COUNT; m++)
+    {
+        if (!(methods & 1 << m))
+            continue;
+        if (started[m])
+            pthread_join(tid[m], NULL);
+
+        if (run[m].count < 0)
+        {
+            // failed run leaves clusters it couldn't merge in copy
+            failed = 1;
+            for (int i = 0; run[m].carr && i < size; i++)
+                clear_cluster(&run[m].carr[i]);
+            xfree(run[m].carr);
+        }
+        else
+        {
+            out[m] = run[m].carr;
+            count[m] = run[m].count;
+        }
+    }
+
+    xfree(dist);
+    return failed ? -1 : 0;
+}
+
+struct cluster_t *copy_clusters(struct cluster_t *carr, int narr)
+{
+    struct cluster_t *copy = xmalloc(sizeof(struct cluster_t) * narr);
+    if (copy == NULL)
+        return NULL;
+
+    for (int i = 0; i < narr; i++)
+    {
+        init_cluster(&copy[i], carr[i].size);
+        for (int j = 0; j < carr[i].size; j++)
+            append_cluster(&copy[i], CLUSTER_OBJ(&carr[i])[j]);
+        copy[i].sx = carr[i].sx;
+        copy[i].sy = carr[i].sy;
+        copy[i].mx = carr[i].mx;
+        copy[i].my = carr[i].my;
+    }
+
+    return copy;
+}
+
+int compare_clusters(struct cluster_t *a, struct cluster_t *b, int narr)
+{
+    for (int i = 0; i < narr; i++)
+    {
+        if (a[i].size != b[i].size)
+            return i;
+
+        for (int j = 0; j < a[i].size; j++)
+        {
+            struct obj_t *o1 = &CLUSTER_OBJ(&a[i])[j];
+            struct obj_t *o2 = &CLUSTER_OBJ(&b[i])[j];
+            if (o1->id != o2->id || o1->x != o2->x || o1->y != o2->y)
+                return i;
+        }
+    }
+
+    return -1;
+}
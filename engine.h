@@ -0,0 +1,149 @@
+/*
+*
+*  @brief     Agglomeration engines
+*  @details   Reference loop and faster engines producing the same clusters
+*  @author    Matej Soroka
+*
+*/
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+
+#include "cluster.h"
+#include "dendro.h"
+
+///@defgroup engine Agglomeration engines
+
+/// Available engines
+enum engine {
+    ENGINE_REF,    ///< find_neighbours and cluster_distance over all pairs
+    ENGINE_MATRIX, ///< distance matrix with nearest neighbour of each row
+    ENGINE_NNCHAIN,///< nearest neighbour chain over centroids, --ward only
+    ENGINE_GENERIC,///< heap of nearest neighbours over centroids
+    ENGINE_COUNT
+};
+
+/// Names of engines used by --engine
+extern const char *const engine_names[ENGINE_COUNT];
+
+/// @struct engine_ws
+/// Memory of engine kept between runs, so repeated runs don't allocate
+struct engine_ws {
+    void *mem;    ///< memory block
+    size_t cap;   ///< size of block in bytes
+};
+
+/// @struct engine_opts
+struct engine_opts {
+    int engine;             ///< one of enum engine
+    int method;             ///< one of enum method
+    int threads;            ///< number of worker threads
+    struct engine_ws *ws;   ///< workspace reused between runs or NULL
+    struct dendro *dendro;  ///< records merges if not NULL
+    const float *dist;      ///< condensed obj_distance of all pairs of
+                            ///< singletons computed before, or NULL
+    const int *index;       ///< singleton i is object index[i] of dist, NULL
+                            ///< if singletons are the objects of dist
+    int dist_n;             ///< number of objects of dist if index is set
+};
+
+/**
+*  Finds engine by name
+*  @ingroup engine
+*  @param name name of engine
+*  @return engine or -1 if name is unknown
+*/
+int engine_by_name(const char *name);
+
+/**
+*  Chooses engine for method when engine isn't given for it: instead of
+*  reference loop --ward runs on nnchain, --centroid and --median on generic,
+*  other methods run on reference loop instead of engines they don't support
+*  @ingroup engine
+*  @param engine configured engine
+*  @param method cluster distance method
+*  @return engine to run
+*/
+int engine_for_method(int engine, int method);
+
+/**
+*  Tells why method can't cluster objects: --ward, --centroid and --median
+*  need objects of two coordinates and Euclidean metric
+*  @ingroup engine
+*  @param obj any object of input
+*  @param method cluster distance method
+*  @return message or NULL if method is supported
+*/
+const char *engine_unsupported(const struct obj_t *obj, int method);
+
+/**
+*  Merges clusters in array until narr clusters remain. Every engine makes
+*  the same merges as the reference loop, so remaining clusters and their
+*  order in array are the same as print_clusters of reference prints.
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts selected engine, method and threads
+*  @pre narr must be between one and size
+*  @return number of clusters in array or -1 if memory can't be allocated
+*          or method is unsupported
+*/
+int engine_run(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts);
+
+/**
+*  Runs engine for several methods at once, every method on its own copy of
+*  clusters in its own thread. Matrix engine of every method copies one
+*  shared matrix of object distances instead of computing it again.
+*  @ingroup engine
+*  @param carr array of clusters, it is not changed
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @param opts engine and threads of every run, method is not used
+*  @param methods bit 1 << method set for every method to run
+*  @param out arrays of clusters of methods, NULL for methods not run
+*  @param count numbers of clusters in out
+*  @return zero or -1 if memory can't be allocated
+*/
+int engine_run_methods(struct cluster_t *carr, int size, int narr, const struct engine_opts *opts,
+                       int methods, struct cluster_t *out[METHOD_COUNT], int count[METHOD_COUNT]);
+
+/**
+*  Computes condensed matrix of obj_distance of all pairs of objects, the
+*  same matrix the matrix engine builds for singletons
+*  @ingroup engine
+*  @param obj array of objects
+*  @param n number of objects
+*  @param threads number of threads
+*  @return matrix of n * (n - 1) / 2 distances or NULL
+*/
+float *distance_matrix(const struct obj_t *obj, int n, int threads);
+
+/**
+*  Frees memory of workspace
+*  @ingroup engine
+*  @param ws workspace
+*/
+void engine_ws_free(struct engine_ws *ws);
+
+/**
+*  Copies array of clusters including objects
+*  @ingroup engine
+*  @param carr array of clusters
+*  @param narr number of clusters in array
+*  @return new array or NULL if memory can't be allocated
+*/
+struct cluster_t *copy_clusters(struct cluster_t *carr, int narr);
+
+/**
+*  Compares two arrays of clusters object by object
+*  @ingroup engine
+*  @param a array of clusters
+*  @param b array of clusters
+*  @param narr number of clusters in arrays
+*  @return index of first different cluster or -1 if arrays are equal
+*/
+int compare_clusters(struct cluster_t *a, struct cluster_t *b, int narr);
+
+#endif
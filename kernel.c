@@ -0,0 +1,607 @@
+/*
+*
+*  @brief     Distance kernels
+*  @details   Scalar and SIMD variants of linkage_distance
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "alloc.h"
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86
+#endif
+
+const char *const isa_names[ISA_COUNT] = { "scalar", "sse2", "avx2" };
+
+const char *const metric_names[METRIC_COUNT] = { "euclidean", "sqeuclidean", "manhattan", "chebyshev", "cosine" };
+
+/// Selected level
+static int selected_isa = ISA_SCALAR;
+
+/// Selected metric
+static int selected_metric = METRIC_EUCLIDEAN;
+
+/**
+*  Checks whether CPU supports level
+*  @ingroup kernel
+*  @param isa level
+*  @return nonzero if level is supported
+*/
+static int isa_supported(int isa)
+{
+#ifdef KERNEL_X86
+    if (isa == ISA_SSE2)
+        return __builtin_cpu_supports("sse2");
+    if (isa == ISA_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return isa == ISA_SCALAR;
+}
+
+int isa_by_name(const char *name)
+{
+    if (!strcmp(name, "auto"))
+    {
+        int best = ISA_SCALAR;
+        for (int i = 0; i < ISA_COUNT; i++)
+            if (isa_supported(i))
+                best = i;
+        return best;
+    }
+
+    for (int i = 0; i < ISA_COUNT; i++)
+        if (!strcmp(name, isa_names[i]))
+            return i;
+    return -1;
+}
+
+int kernel_select(int isa)
+{
+    if (isa < 0 || isa >= ISA_COUNT || !isa_supported(isa))
+        return 0;
+
+    selected_isa = isa;
+    return 1;
+}
+
+int kernel_isa(void)
+{
+    return selected_isa;
+}
+
+int metric_by_name(const char *name)
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+        if (!strcmp(name, metric_names[i]))
+            return i;
+    return -1;
+}
+
+void kernel_select_metric(int metric)
+{
+    selected_metric = metric;
+}
+
+int kernel_metric(void)
+{
+    return selected_metric;
+}
+
+/**********************************************************************/
+/* Row kernels */
+
+/*
+ Every lane repeats the operations of kernel_metric_xy in the same order.
+ No fused multiply-add is used, so every level gives the same floats.
+*/
+
+/**
+*  Scalar row kernel of metric
+*  @ingroup kernel
+*/
+__attribute__((always_inline))
+static inline void row_scalar_metric(float x, float y, const float *xs, const float *ys, int n, float *out,
+                                     int metric)
+{
+    for (int j = 0; j < n; j++)
+        out[j] = kernel_metric_xy(x, y, xs[j], ys[j], metric);
+}
+
+/**
+*  Scalar row kernel, also computes objects left over by SIMD kernels
+*  @ingroup kernel
+*/
+static void row_scalar(float x, float y, const float *xs, const float *ys, int n, float *out)
+{
+    KERNEL_METRIC_CALL(selected_metric, row_scalar_metric, x, y, xs, ys, n, out)
+}
+
+#ifdef KERNEL_X86
+
+/**
+*  Absolute values of SSE2 vector
+*  @ingroup kernel
+*/
+__attribute__((target("sse2"), always_inline))
+static inline __m128 sse2_abs(__m128 a)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+/**
+*  kernel_cosine of SSE2 vectors
+*  @ingroup kernel
+*/
+__attribute__((target("sse2"), always_inline))
+static inline __m128 sse2_cosine(__m128 dot, __m128 nn)
+{
+    __m128 d = _mm_sub_ps(_mm_set1_ps(1), _mm_div_ps(dot, _mm_sqrt_ps(nn)));
+    __m128 some = _mm_cmpgt_ps(nn, _mm_setzero_ps());
+    d = _mm_max_ps(d, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(some, d), _mm_andnot_ps(some, _mm_set1_ps(1)));
+}
+
+/**
+*  Absolute values of AVX2 vector
+*  @ingroup kernel
+*/
+__attribute__((target("avx2"), always_inline))
+static inline __m256 avx2_abs(__m256 a)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+}
+
+/**
+*  kernel_cosine of AVX2 vectors
+*  @ingroup kernel
+*/
+__attribute__((target("avx2"), always_inline))
+static inline __m256 avx2_cosine(__m256 dot, __m256 nn)
+{
+    __m256 d = _mm256_sub_ps(_mm256_set1_ps(1), _mm256_div_ps(dot, _mm256_sqrt_ps(nn)));
+    __m256 some = _mm256_cmp_ps(nn, _mm256_setzero_ps(), _CMP_GT_OQ);
+    d = _mm256_max_ps(d, _mm256_setzero_ps());
+    return _mm256_or_ps(_mm256_and_ps(some, d), _mm256_andnot_ps(some, _mm256_set1_ps(1)));
+}
+
+/// SIMD row kernel of instruction set level, LANES objects at once
+#define ROW_SIMD(isa, tgt, vec, LANES, set1, loadu, storeu, add, sub, mul, vmax, vsqrt) \
+__attribute__((target(tgt), always_inline)) \
+static inline void row_##isa##_metric(float x, float y, const float *xs, const float *ys, int n, \
+                                      float *out, int metric) \
+{ \
+    vec vx = set1(x); \
+    vec vy = set1(y); \
+    vec nx = add(mul(vx, vx), mul(vy, vy)); \
+    int j = 0; \
+    \
+    for (; j + LANES <= n; j += LANES) \
+    { \
+        vec bx = loadu(xs + j); \
+        vec by = loadu(ys + j); \
+        vec a = sub(vx, bx); \
+        vec b = sub(vy, by); \
+        vec d; \
+        if (metric == METRIC_MANHATTAN) \
+            d = add(isa##_abs(a), isa##_abs(b)); \
+        else if (metric == METRIC_CHEBYSHEV) \
+            d = vmax(isa##_abs(a), isa##_abs(b)); \
+        else if (metric == METRIC_COSINE) \
+        { \
+            vec dot = add(mul(vx, bx), mul(vy, by)); \
+            d = isa##_cosine(dot, mul(nx, add(mul(bx, bx), mul(by, by)))); \
+        } \
+        else \
+        { \
+            d = add(mul(a, a), mul(b, b)); \
+            if (metric == METRIC_EUCLIDEAN) \
+                d = vsqrt(d); \
+        } \
+        storeu(out + j, d); \
+    } \
+    \
+    row_scalar_metric(x, y, xs + j, ys + j, n - j, out + j, metric); \
+} \
+\
+__attribute__((target(tgt))) \
+static void row_##isa(float x, float y, const float *xs, const float *ys, int n, float *out) \
+{ \
+    KERNEL_METRIC_CALL(selected_metric, row_##isa##_metric, x, y, xs, ys, n, out) \
+}
+
+ROW_SIMD(sse2, "sse2", __m128, 4, _mm_set1_ps, _mm_loadu_ps, _mm_storeu_ps,
+         _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_max_ps, _mm_sqrt_ps)
+ROW_SIMD(avx2, "avx2", __m256, 8, _mm256_set1_ps, _mm256_loadu_ps, _mm256_storeu_ps,
+         _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_max_ps, _mm256_sqrt_ps)
+
+#endif
+
+void kernel_row(float x, float y, const float *xs, const float *ys, int n, float *out)
+{
+#ifdef KERNEL_X86
+    if (selected_isa == ISA_AVX2)
+    {
+        row_avx2(x, y, xs, ys, n, out);
+        return;
+    }
+    if (selected_isa == ISA_SSE2)
+    {
+        row_sse2(x, y, xs, ys, n, out);
+        return;
+    }
+#endif
+    row_scalar(x, y, xs, ys, n, out);
+}
+
+/**********************************************************************/
+/* Kernels of more dimensions */
+
+/*
+ Every distance except cosine is accumulated from differences in order of
+ coordinates, cosine distance uses norms and dot product summed in order.
+ A tile loads each coordinate of a column once for all of its rows. SIMD
+ tiles vectorize over objects, not over coordinates, so
+ every lane sums in the same order as the scalar code and all levels give
+ the same floats. Each dimension of KERNEL_DIMS gets its own copy of the
+ loops with constant number of coordinates, and every copy is compiled for
+ each metric by KERNEL_METRIC_CALL.
+*/
+
+float kernel_distance(const float *a, const float *b, int dim)
+{
+    KERNEL_METRIC_CALL(selected_metric, return kernel_metric_dim, a, b, dim)
+    return 0;
+}
+
+int kernel_soa_alloc(struct kernel_soa *s, size_t n, int dim)
+{
+    int norms = kernel_dim_dot(selected_metric);
+    size_t floats = n * dim + (norms ? n : 0);
+
+    s->n = n;
+    s->dim = dim;
+    s->c = xmalloc(sizeof(float) * (floats ? floats : 1));
+    s->norm = s->c && norms ? s->c + n * dim : NULL;
+    return s->c != NULL;
+}
+
+void kernel_soa_free(struct kernel_soa *s)
+{
+    xfree(s->c);
+    s->c = s->norm = NULL;
+}
+
+void kernel_soa_set(struct kernel_soa *s, size_t j, const struct obj_t *o)
+{
+    for (int k = 0; k < s->dim; k++)
+        s->c[k * s->n + j] = o->v[k];
+    if (s->norm)
+        s->norm[j] = kernel_dim_norm(o->v, 1, s->dim);
+}
+
+/// @struct soa_tile
+/// Rows and columns of one call of tile kernel
+struct soa_tile {
+    const struct kernel_soa *s;         ///< columns
+    const float *a[KERNEL_TILE_ROWS];   ///< coordinate k of row r is a[r][k * as]
+    size_t as;                          ///< stride of coordinates of rows
+    float na[KERNEL_TILE_ROWS];         ///< squared norms of rows
+    float *out[KERNEL_TILE_ROWS];       ///< distances of rows, NULL if not stored
+    size_t off[KERNEL_TILE_ROWS];       ///< column of out[r][0]
+    size_t j0;                          ///< first column
+    size_t j1;                          ///< end of columns
+};
+
+/**
+*  Scalar tile, also computes columns left over by SIMD tiles
+*  @ingroup kernel
+*  @param t tile
+*  @param j first column
+*  @param dim number of coordinates
+*  @param metric one of enum metric
+*/
+__attribute__((always_inline))
+static inline void tile_scalar(const struct soa_tile *t, size_t j, int dim, int metric)
+{
+    const struct kernel_soa *s = t->s;
+
+    for (; j < t->j1; j++)
+        for (int r = 0; r < KERNEL_TILE_ROWS; r++)
+            if (t->out[r])
+                t->out[r][j - t->off[r]] = kernel_dim_distance(t->a[r], t->as, t->na[r], s->c + j, s->n,
+                                                               s->norm ? s->norm[j] : 0, dim, metric);
+}
+
+#ifdef KERNEL_X86
+
+/// SIMD tile of instruction set level, LANES objects at once
+#define TILE_SIMD(isa, tgt, vec, LANES, set1, zero, loadu, storeu, add, sub, mul, vmax, vsqrt) \
+__attribute__((target(tgt), always_inline)) \
+static inline void tile_##isa(const struct soa_tile *t, int dim, int metric) \
+{ \
+    const struct kernel_soa *s = t->s; \
+    const float *c = s->c; \
+    size_t n = s->n, as = t->as, j = t->j0; \
+    int dot = kernel_dim_dot(metric); \
+    \
+    for (; j + LANES <= t->j1; j += LANES) \
+    { \
+        vec acc[KERNEL_TILE_ROWS]; \
+        for (int r = 0; r < KERNEL_TILE_ROWS; r++) \
+            acc[r] = zero(); \
+        \
+        for (int k = 0; k < dim; k++) \
+        { \
+            vec b = loadu(c + k * n + j); \
+            for (int r = 0; r < KERNEL_TILE_ROWS; r++) \
+            { \
+                vec a = set1(t->a[r][k * as]); \
+                if (dot) \
+                    acc[r] = add(acc[r], mul(a, b)); \
+                else if (metric == METRIC_MANHATTAN) \
+                    acc[r] = add(acc[r], isa##_abs(sub(a, b))); \
+                else if (metric == METRIC_CHEBYSHEV) \
+                    acc[r] = vmax(isa##_abs(sub(a, b)), acc[r]); \
+                else \
+                { \
+                    vec d = sub(a, b); \
+                    acc[r] = add(acc[r], mul(d, d)); \
+                } \
+            } \
+        } \
+        \
+        for (int r = 0; r < KERNEL_TILE_ROWS; r++) \
+        { \
+            if (!t->out[r]) \
+                continue; \
+            vec d2 = acc[r]; \
+            if (dot) \
+                d2 = isa##_cosine(acc[r], mul(set1(t->na[r]), loadu(s->norm + j))); \
+            storeu(t->out[r] + (j - t->off[r]), metric == METRIC_EUCLIDEAN ? vsqrt(d2) : d2); \
+        } \
+    } \
+    \
+    tile_scalar(t, j, dim, metric); \
+}
+
+TILE_SIMD(sse2, "sse2", __m128, 4, _mm_set1_ps, _mm_setzero_ps, _mm_loadu_ps, _mm_storeu_ps,
+          _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_max_ps, _mm_sqrt_ps)
+TILE_SIMD(avx2, "avx2", __m256, 8, _mm256_set1_ps, _mm256_setzero_ps, _mm256_loadu_ps, _mm256_storeu_ps,
+          _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_max_ps, _mm256_sqrt_ps)
+
+/// Specialized tile of level and dimension D
+#define TILE_DIM(isa, tgt, D) \
+__attribute__((target(tgt))) \
+static void tile_##isa##_##D(const struct soa_tile *t) \
+{ \
+    KERNEL_METRIC_CALL(selected_metric, tile_##isa, t, D) \
+}
+#define TILE_DIM_SSE2(D) TILE_DIM(sse2, "sse2", D)
+#define TILE_DIM_AVX2(D) TILE_DIM(avx2, "avx2", D)
+KERNEL_DIMS(TILE_DIM_SSE2)
+KERNEL_DIMS(TILE_DIM_AVX2)
+
+/**
+*  SSE2 tile of any dimension
+*  @ingroup kernel
+*/
+__attribute__((target("sse2")))
+static void tile_sse2_any(const struct soa_tile *t, int dim)
+{
+    KERNEL_METRIC_CALL(selected_metric, tile_sse2, t, dim)
+}
+
+/**
+*  AVX2 tile of any dimension
+*  @ingroup kernel
+*/
+__attribute__((target("avx2")))
+static void tile_avx2_any(const struct soa_tile *t, int dim)
+{
+    KERNEL_METRIC_CALL(selected_metric, tile_avx2, t, dim)
+}
+
+#define TILE_CASE_SSE2(D) case D: tile_sse2_##D(t); return;
+#define TILE_CASE_AVX2(D) case D: tile_avx2_##D(t); return;
+
+#endif
+
+/// Specialized scalar tile of dimension D
+#define TILE_DIM_SCALAR(D) \
+static void tile_scalar_##D(const struct soa_tile *t) \
+{ \
+    KERNEL_METRIC_CALL(selected_metric, tile_scalar, t, t->j0, D) \
+}
+KERNEL_DIMS(TILE_DIM_SCALAR)
+
+#define TILE_CASE_SCALAR(D) case D: tile_scalar_##D(t); return;
+
+/**
+*  Scalar tile of any dimension
+*  @ingroup kernel
+*/
+static void tile_scalar_any(const struct soa_tile *t, int dim)
+{
+    KERNEL_METRIC_CALL(selected_metric, tile_scalar, t, t->j0, dim)
+}
+
+/**
+*  Runs tile on selected level, specialized for dimension if there is one
+*  @ingroup kernel
+*  @param t tile
+*  @param dim number of coordinates
+*/
+static void tile_run(const struct soa_tile *t, int dim)
+{
+#ifdef KERNEL_X86
+    if (selected_isa == ISA_AVX2)
+    {
+        switch (dim)
+        {
+            KERNEL_DIMS(TILE_CASE_AVX2)
+        }
+        tile_avx2_any(t, dim);
+        return;
+    }
+    if (selected_isa == ISA_SSE2)
+    {
+        switch (dim)
+        {
+            KERNEL_DIMS(TILE_CASE_SSE2)
+        }
+        tile_sse2_any(t, dim);
+        return;
+    }
+#endif
+    switch (dim)
+    {
+        KERNEL_DIMS(TILE_CASE_SCALAR)
+    }
+    tile_scalar_any(t, dim);
+}
+
+void kernel_soa_rows(const struct kernel_soa *s, size_t i, int rows, float *const *out)
+{
+    struct soa_tile t;
+
+    t.s = s;
+    t.as = s->n;
+    for (int r = 0; r < KERNEL_TILE_ROWS; r++)
+    {
+        // missing rows repeat the last one and are not stored
+        size_t row = i + (r < rows ? r : rows - 1);
+        t.a[r] = s->c + row;
+        t.na[r] = s->norm ? s->norm[row] : 0;
+        t.out[r] = r < rows ? out[r] : NULL;
+        t.off[r] = i + r + 1;
+    }
+
+    // columns inside the tile belong only to rows above them
+    for (size_t j = i + 1; j < i + rows && j < s->n; j++)
+        for (int r = 0; r < rows && i + r < j; r++)
+            t.out[r][j - t.off[r]] = kernel_dim_distance(t.a[r], t.as, t.na[r], s->c + j, s->n,
+                                                         s->norm ? s->norm[j] : 0, s->dim, selected_metric);
+
+    t.j0 = i + rows;
+    t.j1 = s->n;
+    if (t.j0 < t.j1)
+        tile_run(&t, s->dim);
+}
+
+void kernel_soa_row(const struct obj_t *o, const struct kernel_soa *s, size_t first, int count, float *out)
+{
+    struct soa_tile t;
+
+    t.s = s;
+    t.as = 1;
+    for (int r = 0; r < KERNEL_TILE_ROWS; r++)
+    {
+        t.a[r] = o->v;
+        t.na[r] = s->norm ? kernel_dim_norm(o->v, 1, s->dim) : 0;
+        t.out[r] = r ? NULL : out;
+        t.off[r] = first;
+    }
+    t.j0 = first;
+    t.j1 = first + count;
+    tile_run(&t, s->dim);
+}
+
+/**********************************************************************/
+/* Cluster kernels */
+
+/**
+*  Copies coordinates of cluster into separate arrays
+*  @ingroup kernel
+*  @param c pointer to cluster
+*  @param xs array for x coordinates
+*  @param ys array for y coordinates
+*/
+static void pack_cluster(struct cluster_t *c, float *xs, float *ys)
+{
+    struct obj_t *o = CLUSTER_OBJ(c);
+
+    for (int j = 0; j < c->size; j++)
+    {
+        xs[j] = o[j].x;
+        ys[j] = o[j].y;
+    }
+}
+
+float kernel_linkage(struct cluster_t *c1, struct cluster_t *c2, int method)
+{
+    // --ward, --centroid and --median need only centroids, there is
+    // nothing to vectorize
+    if (method_centroid(method) || selected_isa == ISA_SCALAR || c2->size < 4)
+        return linkage_distance(c1, c2, method);
+
+    // objects of more dimensions are stored by coordinate instead
+    struct obj_t *o1 = CLUSTER_OBJ(c1);
+    struct obj_t *o2 = CLUSTER_OBJ(c2);
+    struct kernel_soa soa;
+    int dim = o2[0].dim;
+    if (dim > 2)
+    {
+        if (!kernel_soa_alloc(&soa, c2->size, dim))
+            return linkage_distance(c1, c2, method);
+        for (int j = 0; j < c2->size; j++)
+            kernel_soa_set(&soa, j, &o2[j]);
+    }
+
+    float stack[2 * KERNEL_BLOCK];
+    float *xs = stack;
+    if (dim == 2 && c2->size > KERNEL_BLOCK && !(xs = xmalloc(2 * sizeof(float) * c2->size)))
+        return linkage_distance(c1, c2, method);
+    float *ys = xs + c2->size;
+    float buf[KERNEL_BLOCK];
+
+    if (dim == 2)
+        pack_cluster(c2, xs, ys);
+
+    float result = method == METHOD_AVG ? 0 : obj_distance(&o1[0], &o2[0]);
+
+    for (int i = 0; i < c1->size; i++)
+    {
+        for (int j = 0; j < c2->size; j += KERNEL_BLOCK)
+        {
+            int n = c2->size - j < KERNEL_BLOCK ? c2->size - j : KERNEL_BLOCK;
+            if (dim > 2)
+                kernel_soa_row(&o1[i], &soa, j, n, buf);
+            else
+                kernel_row(o1[i].x, o1[i].y, xs + j, ys + j, n, buf);
+
+            // average keeps the sequential sum of linkage_distance
+            if (method == METHOD_AVG)
+                for (int k = 0; k < n; k++)
+                    result += buf[k];
+            else if (method == METHOD_MIN)
+            {
+                for (int k = 0; k < n; k++)
+                    if (result > buf[k])
+                        result = buf[k];
+            }
+            else
+            {
+                for (int k = 0; k < n; k++)
+                    if (result < buf[k])
+                        result = buf[k];
+            }
+        }
+    }
+
+    if (dim > 2)
+        kernel_soa_free(&soa);
+    else if (xs != stack)
+        xfree(xs);
+
+    if (method == METHOD_AVG)
+        result = result / (c1->size * c2->size);
+
+    return result;
+}
@@ -0,0 +1,376 @@
+/*
+*
+*  @brief     Distance kernels
+*  @details   Scalar, SIMD, pruned and hull based variants of linkage_distance
+*  @author    Matej Soroka
+*
+*/
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <math.h>
+
+#include "cluster.h"
+
+///@defgroup kernel Distance kernels
+
+/// Instruction set levels of SIMD kernels
+enum isa {
+    ISA_SCALAR, ///< plain C, same code as obj_distance
+    ISA_SSE2,   ///< 4 distances at once
+    ISA_AVX2,   ///< 8 distances at once
+    ISA_COUNT
+};
+
+/// Names of instruction set levels used by --isa
+extern const char *const isa_names[ISA_COUNT];
+
+/// Distance metrics of objects
+enum metric {
+    METRIC_EUCLIDEAN,   ///< square root of sum of squared differences
+    METRIC_SQEUCLIDEAN, ///< sum of squared differences
+    METRIC_MANHATTAN,   ///< sum of absolute differences
+    METRIC_CHEBYSHEV,   ///< largest absolute difference
+    METRIC_COSINE,      ///< one minus cosine of angle of coordinate vectors
+    METRIC_COUNT
+};
+
+/// Names of metrics used by --metric
+extern const char *const metric_names[METRIC_COUNT];
+
+/// Calls f(..., M) where M is metric as a constant, so every metric gets its
+/// own copy of loops of inlined f instead of choosing metric for every pair.
+/// f may be prefixed by return or an assignment.
+#define KERNEL_METRIC_CALL(metric, f, ...) \
+    switch (metric) \
+    { \
+    case METRIC_SQEUCLIDEAN: f(__VA_ARGS__, METRIC_SQEUCLIDEAN); break; \
+    case METRIC_MANHATTAN: f(__VA_ARGS__, METRIC_MANHATTAN); break; \
+    case METRIC_CHEBYSHEV: f(__VA_ARGS__, METRIC_CHEBYSHEV); break; \
+    case METRIC_COSINE: f(__VA_ARGS__, METRIC_COSINE); break; \
+    default: f(__VA_ARGS__, METRIC_EUCLIDEAN); break; \
+    }
+
+/// Objects processed by SIMD kernels in one block
+#define KERNEL_BLOCK 256
+
+/// Rows computed together by kernel_soa_rows
+#define KERNEL_TILE_ROWS 4
+
+/// @struct kernel_soa
+/// Coordinates of objects with more than two dimensions stored by coordinate,
+/// so kernels load the same coordinate of consecutive objects at once
+struct kernel_soa {
+    float *c;       ///< coordinate k of object j is c[k * n + j]
+    float *norm;    ///< squared norms of objects, used by cosine, else NULL
+    size_t n;       ///< number of objects
+    int dim;        ///< number of coordinates
+};
+
+/**
+*  Finds instruction set level by name
+*  @ingroup kernel
+*  @param name name of level or "auto"
+*  @return level, best supported level for "auto" or -1 if name is unknown
+*/
+int isa_by_name(const char *name);
+
+/**
+*  Selects instruction set level used by kernels
+*  @ingroup kernel
+*  @param isa level
+*  @return nonzero if CPU supports the level
+*/
+int kernel_select(int isa);
+
+/**
+*  Selected instruction set level
+*  @ingroup kernel
+*  @return level
+*/
+int kernel_isa(void);
+
+/**
+*  Finds metric by name
+*  @ingroup kernel
+*  @param name name of metric
+*  @return metric or -1 if name is unknown
+*/
+int metric_by_name(const char *name);
+
+/**
+*  Selects metric of obj_distance and all kernels
+*  @ingroup kernel
+*  @param metric one of enum metric
+*/
+void kernel_select_metric(int metric);
+
+/**
+*  Selected metric
+*  @ingroup kernel
+*  @return one of enum metric
+*/
+int kernel_metric(void);
+
+/**
+*  Cosine distance from dot product and product of squared norms, one when
+*  a vector is zero. Rounding above one is clamped, so it is never negative.
+*  @ingroup kernel
+*  @param dot dot product of vectors
+*  @param nn product of squared norms of vectors
+*  @return distance from zero to two
+*/
+static inline float kernel_cosine(float dot, float nn)
+{
+    if (!(nn > 0))
+        return 1;
+    float d = 1 - dot / sqrtf(nn);
+    return d > 0 ? d : 0;
+}
+
+/**
+*  Distance of two points of two coordinates by metric, the operations every
+*  kernel of two coordinates repeats in this order. For METRIC_EUCLIDEAN it is
+*  sub, mul, mul, add, sqrt as in the original obj_distance.
+*  @ingroup kernel
+*  @param x1 x coordinate of first point
+*  @param y1 y coordinate of first point
+*  @param x2 x coordinate of second point
+*  @param y2 y coordinate of second point
+*  @param metric one of enum metric, a constant in loops
+*  @return distance of points, the same for swapped points
+*/
+__attribute__((always_inline))
+static inline float kernel_metric_xy(float x1, float y1, float x2, float y2, int metric)
+{
+    float a = x1 - x2;
+    float b = y1 - y2;
+
+    switch (metric)
+    {
+    case METRIC_SQEUCLIDEAN:
+        a *= a;
+        b *= b;
+        return a + b;
+    case METRIC_MANHATTAN:
+        return fabsf(a) + fabsf(b);
+    case METRIC_CHEBYSHEV:
+        a = fabsf(a);
+        b = fabsf(b);
+        return a > b ? a : b;
+    case METRIC_COSINE:
+        a = x1 * x2;
+        b = y1 * y2;
+        float n1 = x1 * x1;
+        float n2 = x2 * x2;
+        n1 += y1 * y1;
+        n2 += y2 * y2;
+        return kernel_cosine(a + b, n1 * n2);
+    }
+
+    a *= a;
+    b *= b;
+    return sqrtf(a + b);
+}
+
+/// Dimensions with specialized kernels, 2 has kernels of its own above
+#define KERNEL_DIMS(X) X(3) X(4) X(8) X(16) X(32) X(64) X(128)
+
+/**
+*  Tells whether metric is computed from norms and dot products. (Squared)
+*  Euclidean distance is not, |a|^2 + |b|^2 - 2 a.b in float loses the
+*  distance of near points to cancellation.
+*  @ingroup kernel
+*  @param metric one of enum metric
+*  @return nonzero if norms are used
+*/
+static inline int kernel_dim_dot(int metric)
+{
+    return metric == METRIC_COSINE;
+}
+
+/**
+*  Squared norm of point, coordinates summed in order
+*  @ingroup kernel
+*  @param a coordinates, coordinate k is a[k * as]
+*  @param as stride of coordinates
+*  @param dim number of coordinates
+*  @return squared norm
+*/
+static inline float kernel_dim_norm(const float *a, size_t as, int dim)
+{
+    float acc = 0;
+    for (int k = 0; k < dim; k++)
+        acc += a[k * as] * a[k * as];
+    return acc;
+}
+
+/**
+*  Distance of two points of more coordinates, the scalar operations every
+*  kernel repeats
+*  @ingroup kernel
+*  @param a coordinates of point, coordinate k is a[k * as]
+*  @param as stride of a
+*  @param na squared norm of a, used if kernel_dim_dot
+*  @param b coordinates of point, coordinate k is b[k * bs]
+*  @param bs stride of b
+*  @param nb squared norm of b, used if kernel_dim_dot
+*  @param dim number of coordinates
+*  @param metric one of enum metric, a constant in loops
+*  @return distance of points
+*/
+__attribute__((always_inline))
+static inline float kernel_dim_distance(const float *a, size_t as, float na,
+                                        const float *b, size_t bs, float nb, int dim, int metric)
+{
+    float acc = 0;
+
+    if (!kernel_dim_dot(metric))
+    {
+        for (int k = 0; k < dim; k++)
+        {
+            float d = a[k * as] - b[k * bs];
+            if (metric == METRIC_MANHATTAN)
+                acc += fabsf(d);
+            else if (metric == METRIC_CHEBYSHEV)
+                acc = fabsf(d) > acc ? fabsf(d) : acc;
+            else
+                acc += d * d;
+        }
+        return metric == METRIC_EUCLIDEAN ? sqrtf(acc) : acc;
+    }
+
+    for (int k = 0; k < dim; k++)
+        acc += a[k * as] * b[k * bs];
+    return kernel_cosine(acc, na * nb);
+}
+
+/**
+*  Distance of two points stored in order of coordinates
+*  @ingroup kernel
+*  @param a coordinates of point
+*  @param b coordinates of point
+*  @param dim number of coordinates
+*  @param metric one of enum metric, a constant in loops
+*  @return distance of points
+*/
+__attribute__((always_inline))
+static inline float kernel_dim_pair(const float *a, const float *b, int dim, int metric)
+{
+    int dot = kernel_dim_dot(metric);
+    return kernel_dim_distance(a, 1, dot ? kernel_dim_norm(a, 1, dim) : 0,
+                               b, 1, dot ? kernel_dim_norm(b, 1, dim) : 0, dim, metric);
+}
+
+/// Case of specialized dimension D of kernel_metric_dim
+#define KERNEL_DIM_CASE(D) case D: return kernel_dim_pair(a, b, D, metric);
+
+/**
+*  Distance of two points of more coordinates by metric, loops of common
+*  dimensions have constant number of coordinates. Inlined into loops which
+*  get metric as a constant, so only dimension is chosen per pair.
+*  @ingroup kernel
+*  @param a coordinates of point
+*  @param b coordinates of point
+*  @param dim number of coordinates
+*  @param metric one of enum metric, a constant in loops
+*  @return distance of points, the same as kernel_distance
+*/
+__attribute__((always_inline))
+static inline float kernel_metric_dim(const float *a, const float *b, int dim, int metric)
+{
+    switch (dim)
+    {
+        KERNEL_DIMS(KERNEL_DIM_CASE)
+    }
+    return kernel_dim_pair(a, b, dim, metric);
+}
+
+/**
+*  Distances by selected metric from one point to n points stored as
+*  separate coordinate arrays. Every distance is computed by the same
+*  operations as obj_distance, so results are equal to it bit for bit.
+*  @ingroup kernel
+*  @param x x coordinate of point
+*  @param y y coordinate of point
+*  @param xs x coordinates of points
+*  @param ys y coordinates of points
+*  @param n number of points
+*  @param out array for n distances
+*/
+void kernel_row(float x, float y, const float *xs, const float *ys, int n, float *out);
+
+/**
+*  Distance of two points with dim coordinates by selected metric,
+*  kernel_metric_dim for callers without metric as a constant. Coordinates
+*  are summed in order, the same operations as kernel_soa_rows.
+*  @ingroup kernel
+*  @param a coordinates of point
+*  @param b coordinates of point
+*  @param dim number of coordinates
+*  @return distance of points
+*/
+float kernel_distance(const float *a, const float *b, int dim);
+
+/**
+*  Allocates coordinate storage for n objects
+*  @ingroup kernel
+*  @param s storage
+*  @param n number of objects
+*  @param dim number of coordinates
+*  @return nonzero if memory was allocated
+*/
+int kernel_soa_alloc(struct kernel_soa *s, size_t n, int dim);
+
+/**
+*  Frees coordinate storage
+*  @ingroup kernel
+*  @param s storage
+*/
+void kernel_soa_free(struct kernel_soa *s);
+
+/**
+*  Stores coordinates of object
+*  @ingroup kernel
+*  @param s storage
+*  @param j index of object in storage
+*  @param o object with s->dim coordinates
+*/
+void kernel_soa_set(struct kernel_soa *s, size_t j, const struct obj_t *o);
+
+/**
+*  Distances of rows i to i + rows - 1 to all higher objects, computed in
+*  tiles of rows times SIMD width, every distance equal to kernel_distance
+*  bit for bit
+*  @ingroup kernel
+*  @param s storage
+*  @param i first row
+*  @param rows number of rows, at most KERNEL_TILE_ROWS
+*  @param out out[r] gets distances of row i + r to objects i + r + 1 to n - 1
+*/
+void kernel_soa_rows(const struct kernel_soa *s, size_t i, int rows, float *const *out);
+
+/**
+*  Distances of object to objects first to first + count - 1 of storage,
+*  equal to kernel_distance bit for bit
+*  @ingroup kernel
+*  @param o object with s->dim coordinates
+*  @param s storage
+*  @param first first object of storage
+*  @param count number of objects
+*  @param out array for count distances
+*/
+void kernel_soa_row(const struct obj_t *o, const struct kernel_soa *s, size_t first, int count, float *out);
+
+/**
+*  linkage_distance computed with SIMD kernel of selected level. Average
+*  sums distances in the same order as linkage_distance.
+*  @ingroup kernel
+*  @param c1 pointer to cluster
+*  @param c2 pointer to cluster
+*  @param method one of enum method
+*  @return distance between two clusters, equal to linkage_distance
+*/
+float kernel_linkage(struct cluster_t *c1, struct cluster_t *c2, int method);
+
+#endif
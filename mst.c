@@ -0,0 +1,423 @@
+/*
+*
+*  @brief     Incremental single linkage
+*  @details   Minimum spanning tree of objects kept in file and updated by
+*             inserting new objects
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "kernel.h"
+#include "mst.h"
+#include "stats.h"
+
+/// @struct mst_header
+/// Beginning of tree file, objects and edges follow
+struct mst_header {
+    char magic[8];  ///< "PROJ3MS\1"
+    int32_t n;      ///< number of objects
+    int32_t pad;    ///< zero
+};
+
+static const char mst_magic[8] = "PROJ3MS\1";
+
+/// Object in tree file
+struct mst_obj {
+    int32_t id;  ///< unique ID of object
+    float x;     ///< x coordinate
+    float y;     ///< y coordinate
+};
+
+/// Neighbour in adjacency of tree
+struct adj {
+    int v;    ///< position of neighbour
+    int e;    ///< index of edge in tree
+};
+
+void mst_init(struct mst *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void mst_free(struct mst *t)
+{
+    xfree(t->obj);
+    xfree(t->xs);
+    xfree(t->edges);
+    mst_init(t);
+}
+
+/**
+*  Grows arrays of tree
+*  @ingroup mst
+*  @param t tree
+*  @param cap requested number of objects
+*  @return nonzero if memory was allocated
+*/
+static int mst_reserve(struct mst *t, int cap)
+{
+    if (cap <= t->cap)
+        return 1;
+
+    struct obj_t *obj = xrealloc(t->obj, sizeof(struct obj_t) * cap);
+    if (obj == NULL)
+        return 0;
+    t->obj = obj;
+
+    struct edge *edges = xrealloc(t->edges, sizeof(struct edge) * cap);
+    if (edges == NULL)
+        return 0;
+    t->edges = edges;
+
+    // xs and ys share one block, ys moves with the capacity
+    float *xs = xrealloc(t->xs, 2 * sizeof(float) * cap);
+    if (xs == NULL)
+        return 0;
+    memmove(xs + cap, xs + t->cap, sizeof(float) * t->n);
+    t->xs = xs;
+    t->ys = xs + cap;
+    t->cap = cap;
+    return 1;
+}
+
+/**
+*  Compares edges by distance, equal distances by higher pair first as the
+*  reference loop prefers the last of equal pairs
+*  @ingroup mst
+*  @param a first edge
+*  @param b second edge
+*  @return negative if a is merged first
+*/
+static int edge_cmp(const void *a, const void *b)
+{
+    const struct edge *ea = a, *eb = b;
+
+    if (ea->w != eb->w)
+        return ea->w < eb->w ? -1 : 1;
+
+    int la = ea->u < ea->v ? ea->u : ea->v, lb = eb->u < eb->v ? eb->u : eb->v;
+    int ha = ea->u ^ ea->v ^ la, hb = eb->u ^ eb->v ^ lb;
+    if (la != lb)
+        return lb - la;
+    return hb - ha;
+}
+
+int mst_insert(struct mst *t, struct obj_t o)
+{
+    int n = t->n;
+
+    if (n == t->cap && !mst_reserve(t, t->cap ? 2 * t->cap : 64))
+        return 0;
+
+    if (n > 0)
+    {
+        size_t bytes = sizeof(struct edge) * 3 * n + sizeof(struct adj) * 2 * (n - 1) +
+                       sizeof(float) * n + sizeof(int) * (5 * n + 1) + n;
+        void *mem = xmalloc(bytes);
+        if (mem == NULL)
+            return 0;
+
+        struct edge *best = mem;
+        struct edge *fresh = best + n;
+        struct edge *out = fresh + n;
+        struct adj *adj = (struct adj *)(out + n);
+        float *dist = (float *)(adj + 2 * (n - 1));
+        int *start = (int *)(dist + n);
+        int *order = start + n + 1;
+        int *parent = order + n;
+        int *pe = parent + n;
+        int *bi = pe + n;
+        char *kept = (char *)(bi + n);
+
+        kernel_row(o.x, o.y, t->xs, t->ys, n, dist);
+        stats_add(obj_distance, n);
+
+        // adjacency of tree in compressed rows
+        memset(start, 0, sizeof(int) * (n + 1));
+        for (int e = 0; e < n - 1; e++)
+        {
+            start[t->edges[e].u + 1]++;
+            start[t->edges[e].v + 1]++;
+        }
+        for (int i = 0; i < n; i++)
+            start[i + 1] += start[i];
+        for (int e = 0; e < n - 1; e++)
+        {
+            struct edge *ed = &t->edges[e];
+            adj[start[ed->u]++] = (struct adj){ ed->v, e };
+            adj[start[ed->v]++] = (struct adj){ ed->u, e };
+        }
+        for (int i = n; i > 0; i--)
+            start[i] = start[i - 1];
+        start[0] = 0;
+
+        // breadth first order puts every parent before its children
+        int tail = 1;
+        order[0] = 0;
+        parent[0] = -1;
+        for (int head = 0; head < tail; head++)
+        {
+            int u = order[head];
+            for (int k = start[u]; k < start[u + 1]; k++)
+                if (adj[k].v != parent[u])
+                {
+                    parent[adj[k].v] = u;
+                    pe[adj[k].v] = adj[k].e;
+                    order[tail++] = adj[k].v;
+                }
+        }
+
+        // best[u] is the cheapest edge leaving subtree of u towards the new
+        // object, every tree edge and the best edge of its subtree close a
+        // cycle with the new object, the cheaper one stays in the tree and
+        // the heavier one competes for the best edge of the parent. bi[u] is
+        // index of best[u] in tree, -1 for edges of the new object.
+        for (int i = 0; i < n; i++)
+        {
+            best[i] = (struct edge){ n, i, dist[i] };
+            bi[i] = -1;
+        }
+        memset(kept, 0, n);
+
+        int count = 0;
+        for (int i = n - 1; i > 0; i--)
+        {
+            int u = order[i], q = parent[u];
+            struct edge keep = t->edges[pe[u]], cand = best[u];
+            int ki = pe[u], ci = bi[u];
+
+            if (cand.w < keep.w)
+            {
+                struct edge e = keep;
+                int ei = ki;
+                keep = cand;
+                ki = ci;
+                cand = e;
+                ci = ei;
+            }
+            if (ki < 0)
+                fresh[count++] = keep;
+            else
+                kept[ki] = 1;
+            if (cand.w < best[q].w)
+            {
+                best[q] = cand;
+                bi[q] = ci;
+            }
+        }
+        if (bi[0] < 0)
+            fresh[count++] = best[0];
+        else
+            kept[bi[0]] = 1;
+
+        // kept edges of tree are sorted already, only edges of the new
+        // object are sorted and merged into them
+        qsort(fresh, count, sizeof(struct edge), edge_cmp);
+        int k = 0, f = 0;
+        for (int e = 0; e < n - 1; e++)
+        {
+            if (!kept[e])
+                continue;
+            while (f < count && edge_cmp(&fresh[f], &t->edges[e]) < 0)
+                out[k++] = fresh[f++];
+            out[k++] = t->edges[e];
+        }
+        while (f < count)
+            out[k++] = fresh[f++];
+        memcpy(t->edges, out, sizeof(struct edge) * n);
+        xfree(mem);
+    }
+
+    t->obj[n] = o;
+    t->xs[n] = o.x;
+    t->ys[n] = o.y;
+    t->n++;
+    return 1;
+}
+
+/**
+*  Finds lowest position of component
+*  @ingroup mst
+*  @param root parent of every position in union-find
+*  @param i position
+*  @return lowest position of component of i
+*/
+static int find_root(int *root, int i)
+{
+    while (root[i] != i)
+    {
+        root[i] = root[root[i]];
+        i = root[i];
+    }
+    return i;
+}
+
+int mst_load(struct mst *t, const char *path)
+{
+    struct mst_header h;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+        return 0;
+
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, mst_magic, 8) &&
+             h.n >= 0 && mst_reserve(t, h.n > 64 ? h.n : 64);
+
+    struct mst_obj rec;
+    for (int i = 0; ok && i < h.n; i++)
+    {
+        ok = fread(&rec, sizeof(rec), 1, f) == 1;
+        t->obj[i] = (struct obj_t){ rec.id, rec.x, rec.y, 2, NULL };
+    }
+    ok = ok && (h.n == 0 || (int)fread(t->edges, sizeof(struct edge), h.n - 1, f) == h.n - 1);
+    fclose(f);
+
+    // edges must form a tree, else insertion would walk a cycle
+    int *root = ok ? xmalloc(sizeof(int) * (h.n > 0 ? h.n : 1)) : NULL;
+    ok = ok && root != NULL;
+    for (int i = 0; ok && i < h.n; i++)
+        root[i] = i;
+    for (int e = 0; ok && e < h.n - 1; e++)
+    {
+        struct edge *ed = &t->edges[e];
+        ok = ed->u >= 0 && ed->u < h.n && ed->v >= 0 && ed->v < h.n;
+        int a = ok ? find_root(root, ed->u) : 0, b = ok ? find_root(root, ed->v) : 0;
+        ok = ok && a != b;
+        if (ok)
+            root[a > b ? a : b] = a < b ? a : b;
+    }
+    xfree(root);
+
+    if (!ok)
+    {
+        mst_free(t);
+        return -1;
+    }
+
+    // mst_insert keeps edges sorted, a file written without that order is
+    // sorted once
+    for (int e = 1; e < h.n - 1; e++)
+        if (edge_cmp(&t->edges[e - 1], &t->edges[e]) > 0)
+        {
+            qsort(t->edges, h.n - 1, sizeof(struct edge), edge_cmp);
+            break;
+        }
+
+    t->n = h.n;
+    for (int i = 0; i < t->n; i++)
+    {
+        t->xs[i] = t->obj[i].x;
+        t->ys[i] = t->obj[i].y;
+    }
+    return 1;
+}
+
+int mst_save(const struct mst *t, const char *path)
+{
+    struct mst_header h;
+    char tmp[4200];
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, mst_magic, 8);
+    h.n = t->n;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+        return 0;
+
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (int i = 0; ok && i < t->n; i++)
+    {
+        struct mst_obj rec = { t->obj[i].id, t->obj[i].x, t->obj[i].y };
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+    }
+    ok = ok && (t->n == 0 || (int)fwrite(t->edges, sizeof(struct edge), t->n - 1, f) == t->n - 1);
+    ok = !fclose(f) && ok && !rename(tmp, path);
+    if (!ok)
+        remove(tmp);
+    return ok;
+}
+
+int mst_dendro(const struct mst *t, struct dendro *d)
+{
+    int n = t->n;
+    const struct edge *edges = t->edges;
+    int *root = xmalloc(sizeof(int) * (n > 0 ? n : 1));
+
+    if (root == NULL || !dendro_init(d, n))
+    {
+        xfree(root);
+        return 0;
+    }
+
+    // merged cluster keeps the lowest position, as in engines
+    for (int i = 0; i < n; i++)
+        root[i] = i;
+    for (int e = 0; e < n - 1; e++)
+    {
+        int a = find_root(root, edges[e].u), b = find_root(root, edges[e].v);
+        if (a > b)
+        {
+            int tmp = a;
+            a = b;
+            b = tmp;
+        }
+        root[b] = a;
+        dendro_add(d, a, b, edges[e].w);
+    }
+
+    xfree(root);
+    return 1;
+}
+
+int mst_run(const char *path, struct cluster_t **carr, int size, int narr)
+{
+    struct mst t;
+    struct dendro d;
+    int r, ok = 1;
+
+    mst_init(&t);
+    if ((r = mst_load(&t, path)) < 0)
+    {
+        fprintf(stderr, "Tree file is invalid\n");
+        return -1;
+    }
+
+    // tree file keeps two coordinates of objects
+    int flat = size == 0 || CLUSTER_OBJ(&(*carr)[0])[0].dim == 2;
+    for (int i = 0; i < size; i++)
+    {
+        if (ok && flat && (*carr)[i].size == 1)
+            ok = mst_insert(&t, CLUSTER_OBJ(&(*carr)[i])[0]);
+        clear_cluster(&(*carr)[i]);
+    }
+    xfree(*carr);
+    *carr = NULL;
+
+    int count = -1;
+    if (!flat)
+        fprintf(stderr, "Incremental mode supports only 2-D objects\n");
+    else if (!ok)
+        fprintf(stderr, "Memory allocation was not succeed\n");
+    else if (narr > t.n)
+        fprintf(stderr, "Argument is greater that count of clusters\n");
+    else if (!mst_save(&t, path))
+        fprintf(stderr, "Tree file can't be written\n");
+    else if (!mst_dendro(&t, &d))
+        fprintf(stderr, "Memory allocation was not succeed\n");
+    else
+    {
+        if ((count = dendro_cut(&d, t.obj, narr, carr)) < 0)
+            fprintf(stderr, "Memory allocation was not succeed\n");
+        dendro_free(&d);
+    }
+
+    mst_free(&t);
+    return count;
+}
@@ -0,0 +1,112 @@
+/*
+*
+*  @brief     Incremental single linkage
+*  @details   Minimum spanning tree of objects kept in file and updated by
+*             inserting new objects
+*  @author    Matej Soroka
+*
+*/
+#ifndef MST_H
+#define MST_H
+
+#include "cluster.h"
+#include "dendro.h"
+
+///@defgroup mst Incremental single linkage
+
+/*
+ Single linkage clusters are components of the minimum spanning tree of
+ objects after its heaviest edges are removed. Minimum spanning tree of
+ tree plus one new vertex is made only of tree edges and edges of the new
+ vertex, so insertion needs one pass over the tree and distances to the new
+ object, O(n) per object (Chin and Houck). Edges stay sorted, only edges of
+ the new object are sorted and merged in, so a cut needs no sort. Objects keep their positions,
+ new ones are appended, so a cut is the same as --min of file with all
+ objects in that order. Only when distances at the cut are equal, the
+ reference loop may choose another of the equal merges.
+*/
+
+/// @struct edge
+struct edge {
+    int u;    ///< position of object
+    int v;    ///< position of object
+    float w;  ///< distance of objects
+};
+
+/// @struct mst
+struct mst {
+    int n;               ///< number of objects
+    int cap;             ///< capacity of arrays
+    struct obj_t *obj;   ///< objects in order of insertion
+    float *xs;           ///< x of objects for distance kernel
+    float *ys;           ///< y of objects for distance kernel
+    struct edge *edges;  ///< n - 1 edges of tree in order of merges, by
+                         ///< distance and equal distances by higher pair
+};
+
+/**
+*  Prepares empty tree
+*  @ingroup mst
+*  @param t tree
+*/
+void mst_init(struct mst *t);
+
+/**
+*  Frees memory of tree
+*  @ingroup mst
+*  @param t tree
+*/
+void mst_free(struct mst *t);
+
+/**
+*  Inserts object into tree in O(n), edges of new object are merged into
+*  sorted edges of tree
+*  @ingroup mst
+*  @param t tree
+*  @param o object
+*  @return nonzero if object was inserted, zero if memory can't be allocated
+*/
+int mst_insert(struct mst *t, struct obj_t o);
+
+/**
+*  Loads tree saved by mst_save
+*  @ingroup mst
+*  @param t empty tree
+*  @param path name of file
+*  @return 1 if tree was loaded, 0 if file doesn't exist, -1 if file is
+*          invalid or memory can't be allocated
+*/
+int mst_load(struct mst *t, const char *path);
+
+/**
+*  Saves tree, file is replaced only when it is written completely
+*  @ingroup mst
+*  @param t tree
+*  @param path name of file
+*  @return nonzero if tree was saved
+*/
+int mst_save(const struct mst *t, const char *path);
+
+/**
+*  Builds dendrogram of single linkage from tree in O(n), merges in order
+*  of sorted edges
+*  @ingroup mst
+*  @param t tree
+*  @param d dendrogram to initialize
+*  @return nonzero if memory was allocated
+*/
+int mst_dendro(const struct mst *t, struct dendro *d);
+
+/**
+*  Inserts loaded objects into saved tree, saves it and cuts it to narr
+*  clusters. Tree file is created if it doesn't exist.
+*  @ingroup mst
+*  @param path name of tree file
+*  @param carr pointer to array of loaded singletons, array is replaced
+*  @param size number of clusters in array
+*  @param narr requested number of clusters
+*  @return number of clusters in array or -1 on error
+*/
+int mst_run(const char *path, struct cluster_t **carr, int size, int narr);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+*
+*  @brief     Placement of threads and memory
+*  @details   CPU affinity of workers for --cpus and --pin, transparent
+*             huge pages of big arrays for --thp
+*  @author    Matej Soroka
+*
+*/
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "numa.h"
+
+int numa_pinning = 0;
+int numa_hugepages = 0;
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/// Smallest array advised to use huge pages, one huge page of x86-64
+#define NUMA_HUGE_BYTES (2u << 20)
+
+/// CPUs of list in increasing order
+static int numa_cpu[CPU_SETSIZE];
+
+/// Number of workers running on CPU of list at the same index
+static int numa_used[CPU_SETSIZE];
+
+/// Number of CPUs of list
+static int numa_count = 0;
+
+/// Guards numa_used
+static pthread_mutex_t numa_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Index of CPU of calling thread in list, -1 if it isn't pinned
+static __thread int numa_slot = -1;
+
+/**
+*  Parses list of CPUs
+*  @ingroup numa
+*  @param list comma separated CPUs and ranges of CPUs
+*  @param set set for CPUs
+*  @return nonzero if list is valid
+*/
+static int numa_parse(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*list)
+    {
+        char *end;
+        long lo = strtol(list, &end, 10), hi = lo;
+
+        if (end == list || *list == '-' || *list == '+')
+            return 0;
+        if (*end == '-')
+        {
+            list = end + 1;
+            hi = strtol(list, &end, 10);
+            if (end == list || *list == '-' || *list == '+')
+                return 0;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+            return 0;
+
+        for (long c = lo; c <= hi; c++)
+            CPU_SET(c, set);
+        list = *end == ',' && end[1] ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+int numa_init(const char *cpus, int pin)
+{
+    cpu_set_t set;
+
+    if (cpus && (!numa_parse(cpus, &set) || sched_setaffinity(0, sizeof(set), &set)))
+        return 0;
+
+    // kernel keeps only CPUs of list which are online and allowed
+    if (sched_getaffinity(0, sizeof(set), &set))
+        return 0;
+    numa_count = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &set))
+            numa_cpu[numa_count++] = c;
+
+    numa_pinning = pin && numa_count > 0;
+
+    // this thread runs the first share of every pool
+    numa_pin();
+    return 1;
+}
+
+int numa_pin(void)
+{
+    if (!numa_pinning || numa_slot >= 0)
+        return 0;
+
+    pthread_mutex_lock(&numa_lock);
+    int best = 0;
+    for (int i = 1; i < numa_count; i++)
+        if (numa_used[i] < numa_used[best])
+            best = i;
+    numa_used[best]++;
+    pthread_mutex_unlock(&numa_lock);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(numa_cpu[best], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    numa_slot = best;
+    return 1;
+}
+
+void numa_unpin(int pinned)
+{
+    if (!pinned)
+        return;
+
+    pthread_mutex_lock(&numa_lock);
+    numa_used[numa_slot]--;
+    pthread_mutex_unlock(&numa_lock);
+    numa_slot = -1;
+}
+
+void numa_advise(void *p, size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+    if (!numa_hugepages || bytes < NUMA_HUGE_BYTES)
+        return;
+
+    // only whole pages inside of array may be advised
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)p + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)p + bytes) & ~(page - 1);
+    if (end > start)
+        madvise((void *)start, end - start, MADV_HUGEPAGE);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+#else
+
+int numa_init(const char *cpus, int pin)
+{
+    (void)pin;
+    // affinity isn't supported, only the default placement is valid
+    return cpus == NULL;
+}
+
+int numa_pin(void)
+{
+    return 0;
+}
+
+void numa_unpin(int pinned)
+{
+    (void)pinned;
+}
+
+void numa_advise(void *p, size_t bytes)
+{
+    (void)p;
+    (void)bytes;
+}
+
+#endif
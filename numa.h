@@ -0,0 +1,67 @@
+/*
+*
+*  @brief     Placement of threads and memory
+*  @details   CPU affinity of workers for --cpus and --pin, transparent
+*             huge pages of big arrays for --thp
+*  @author    Matej Soroka
+*
+*/
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+
+///@defgroup numa Placement of threads and memory
+
+/*
+ Memory of a page is placed on the node of the CPU that first writes it.
+ Workers write the rows of matrices they own, so when every worker stays on
+ one CPU, its rows stay on its node. Pinned workers take the least used CPU
+ of the list, so nested pools (batch jobs or methods running engines with
+ threads) spread over the list too. A pinned thread running another pool's
+ share keeps its CPU.
+*/
+
+/// Workers are pinned by numa_pin
+extern int numa_pinning;
+
+/// Big arrays are advised to use transparent huge pages
+extern int numa_hugepages;
+
+/**
+*  Restricts process to CPUs of list and pins calling thread to the first
+*  of them if workers are pinned. Must be called before threads are
+*  started.
+*  @ingroup numa
+*  @param cpus comma separated CPUs and ranges of CPUs (0-3,8) or NULL for
+*         CPUs the process may run on
+*  @param pin nonzero if every worker runs on one CPU
+*  @return nonzero if list is valid and affinity was set
+*/
+int numa_init(const char *cpus, int pin);
+
+/**
+*  Pins calling worker to least used CPU of list, called at start of worker
+*  @ingroup numa
+*  @return nonzero if thread was pinned now, zero if pinning is off or
+*          thread is pinned already
+*/
+int numa_pin(void);
+
+/**
+*  Returns CPU of worker to list, called at end of worker
+*  @ingroup numa
+*  @param pinned result of numa_pin
+*/
+void numa_unpin(int pinned);
+
+/**
+*  Advises pages of array to be transparent huge pages if --thp is used
+*  and array is big, must be called before array is written
+*  @ingroup numa
+*  @param p array
+*  @param bytes size of array
+*/
+void numa_advise(void *p, size_t bytes);
+
+#endif
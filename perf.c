@@ -0,0 +1,163 @@
+/*
+*
+*  @brief     Hardware performance counters
+*  @details   perf_event_open sampling of phases for --perf
+*  @author    Matej Soroka
+*
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "perf.h"
+
+/// Number of sampled hardware events
+#define PERF_EVENTS 4
+
+/// Names of sampled events used in report
+static const char *event_names[PERF_EVENTS] = {
+    "cycles", "instructions", "LLC-misses", "branch-misses"
+};
+
+/// File descriptors of counters, -1 if counter is not available
+static int perf_fd[PERF_EVENTS] = { -1, -1, -1, -1 };
+
+/// Counter values at start of running phase
+static unsigned long long perf_start[PHASE_COUNT][PERF_EVENTS];
+
+/// Accumulated counter values of phases
+static unsigned long long perf_total[PHASE_COUNT][PERF_EVENTS];
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+int perf_open(void)
+{
+    static const unsigned long long config[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    int opened = 0;
+
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // counts threads created later as well (parallel engines)
+        attr.inherit = 1;
+
+        perf_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf_fd[i] >= 0)
+            opened++;
+    }
+
+    if (!opened)
+        fprintf(stderr, "Hardware performance counters are not available\n");
+
+    return opened;
+}
+
+/**
+*  Reads current values of all counters
+*  @ingroup perf
+*  @param v array for values
+*/
+static void perf_read(unsigned long long v[PERF_EVENTS])
+{
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        v[i] = 0;
+        if (perf_fd[i] >= 0 && read(perf_fd[i], &v[i], sizeof(v[i])) != sizeof(v[i]))
+            v[i] = 0;
+    }
+}
+
+/**
+*  Closes all counters
+*  @ingroup perf
+*/
+static void perf_close(void)
+{
+    for (int i = 0; i < PERF_EVENTS; i++)
+        if (perf_fd[i] >= 0)
+        {
+            close(perf_fd[i]);
+            perf_fd[i] = -1;
+        }
+}
+
+#else
+
+int perf_open(void)
+{
+    fprintf(stderr, "Hardware performance counters are supported only on Linux\n");
+    return 0;
+}
+
+static void perf_read(unsigned long long v[PERF_EVENTS])
+{
+    memset(v, 0, sizeof(v[0]) * PERF_EVENTS);
+}
+
+static void perf_close(void)
+{
+}
+
+#endif
+
+void perf_phase_begin(enum phase p)
+{
+    perf_read(perf_start[p]);
+}
+
+void perf_phase_end(enum phase p)
+{
+    unsigned long long now[PERF_EVENTS];
+    perf_read(now);
+
+    for (int i = 0; i < PERF_EVENTS; i++)
+        perf_total[p][i] += now[i] - perf_start[p][i];
+}
+
+void perf_report(void)
+{
+    fprintf(stderr, "Perf:\n%-12s", "phase");
+    for (int i = 0; i < PERF_EVENTS; i++)
+        fprintf(stderr, " %16s", event_names[i]);
+    fprintf(stderr, " %8s %8s\n", "IPC", "LLC-MPKI");
+
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        fprintf(stderr, "%-12s", phase_names[p]);
+        for (int i = 0; i < PERF_EVENTS; i++)
+        {
+            if (perf_fd[i] >= 0)
+                fprintf(stderr, " %16llu", perf_total[p][i]);
+            else
+                fprintf(stderr, " %16s", "n/a");
+        }
+
+        // low IPC together with high misses per kilo-instruction means
+        // the phase waits for memory rather than computes
+        if (perf_total[p][0] && perf_total[p][1])
+            fprintf(stderr, " %8.2f %8.2f\n",
+                    (double)perf_total[p][1] / perf_total[p][0],
+                    1000.0 * perf_total[p][2] / perf_total[p][1]);
+        else
+            fprintf(stderr, " %8s %8s\n", "-", "-");
+    }
+
+    perf_close();
+}
@@ -0,0 +1,44 @@
+/*
+*
+*  @brief     Hardware performance counters
+*  @details   perf_event_open sampling of phases for --perf
+*  @author    Matej Soroka
+*
+*/
+#ifndef PERF_H
+#define PERF_H
+
+#include "stats.h"
+
+///@defgroup perf Hardware performance counters
+
+/**
+*  Opens counters of cycles, instructions, LLC misses and branch misses
+*  for the calling process. Counters which can't be opened are reported
+*  as unavailable.
+*  @ingroup perf
+*  @return nonzero if at least one counter was opened
+*/
+int perf_open(void);
+
+/**
+*  Reads counters at start of phase
+*  @ingroup perf
+*  @param p phase
+*/
+void perf_phase_begin(enum phase p);
+
+/**
+*  Adds counter deltas since perf_phase_begin to phase
+*  @ingroup perf
+*  @param p phase
+*/
+void perf_phase_end(enum phase p);
+
+/**
+*  Prints counters of every phase to stderr and closes counters
+*  @ingroup perf
+*/
+void perf_report(void);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+*
+*  @brief     Progress reporting
+*  @details   Remaining clusters, merge rate and ETA on stderr for --progress
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <math.h>
+
+#include "progress.h"
+#include "stats.h"
+
+/// Clock is read about this often, so ticks stay cheap in fast loops
+#define PROGRESS_CHECK 0.01
+
+int progressing;
+long progress_countdown = 1;
+
+/// State of progress reporting
+static struct {
+    double interval;    ///< seconds between reports
+    double start;       ///< time of progress_start
+    double last_check;  ///< time of last clock read
+    double last_report; ///< time of last report
+    int last_live;      ///< clusters at last report
+    int last_tick_live; ///< clusters at last clock read
+    int size;           ///< clusters at start
+    int narr;           ///< requested clusters
+    double exponent;    ///< cost of merge ~ clusters^exponent
+} progress = { 2.0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+void progress_interval(double seconds)
+{
+    progress.interval = seconds;
+}
+
+/**
+*  Work left from k clusters to requested count, sum of k^exponent
+*  approximated by integral
+*  @ingroup progress
+*  @param k number of clusters
+*  @return work in arbitrary units
+*/
+static double work_left(int k)
+{
+    double e = progress.exponent + 1;
+    return (pow(k, e) - pow(progress.narr, e)) / e;
+}
+
+void progress_start(int size, int narr, double exponent)
+{
+    progress.size = progress.last_live = progress.last_tick_live = size;
+    progress.narr = narr;
+    progress.exponent = exponent;
+    progress.start = progress.last_check = progress.last_report = stats_now();
+    progress_countdown = 1;
+}
+
+/**
+*  Prints duration as hours, minutes and seconds
+*  @ingroup progress
+*  @param s duration in seconds
+*/
+static void print_duration(double s)
+{
+    long t = (long)(s + 0.5);
+    if (t >= 3600)
+        fprintf(stderr, "%ldh%02ldm%02lds", t / 3600, t / 60 % 60, t % 60);
+    else if (t >= 60)
+        fprintf(stderr, "%ldm%02lds", t / 60, t % 60);
+    else
+        fprintf(stderr, "%lds", t);
+}
+
+void progress_check(int live)
+{
+    double now = stats_now();
+    int ticks = progress.last_tick_live - live;
+
+    // next check after about PROGRESS_CHECK seconds at current speed
+    if (now > progress.last_check && ticks > 0)
+        progress_countdown = (long)(ticks * PROGRESS_CHECK / (now - progress.last_check)) + 1;
+    else
+        progress_countdown = 2 * ticks + 1;
+    progress.last_check = now;
+    progress.last_tick_live = live;
+
+    if (now - progress.last_report < progress.interval)
+        return;
+
+    double elapsed = now - progress.start;
+    double done = work_left(progress.size) - work_left(live);
+    double rate = (progress.last_live - live) / (now - progress.last_report);
+
+    fprintf(stderr, "progress: %d clusters left (target %d), %.1f merges/s, ETA ",
+            live, progress.narr, rate);
+    if (done > 0)
+        print_duration(elapsed / done * work_left(live));
+    else
+        fprintf(stderr, "?");
+    fprintf(stderr, "\n");
+
+    progress.last_report = now;
+    progress.last_live = live;
+}
+
+void progress_finish(void)
+{
+    fprintf(stderr, "progress: done, %d merges in ", progress.size - progress.narr);
+    print_duration(stats_now() - progress.start);
+    fprintf(stderr, "\n");
+}
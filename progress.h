@@ -0,0 +1,51 @@
+/*
+*
+*  @brief     Progress reporting
+*  @details   Remaining clusters, merge rate and ETA on stderr for --progress
+*  @author    Matej Soroka
+*
+*/
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+///@defgroup progress Progress reporting
+
+/// Nonzero when --progress is set
+extern int progressing;
+
+/// Iterations left until the clock is read again
+extern long progress_countdown;
+
+/// counts iteration, reads clock only once per progress_countdown iterations
+#define progress_tick(live) do { if (progressing && --progress_countdown <= 0) progress_check(live); } while (0)
+
+/**
+*  Starts reporting of run
+*  @ingroup progress
+*  @param size number of clusters at start
+*  @param narr requested number of clusters
+*  @param exponent cost of merge is proportional to clusters^exponent
+*/
+void progress_start(int size, int narr, double exponent);
+
+/**
+*  Prints progress if interval elapsed and plans next clock check
+*  @ingroup progress
+*  @param live number of clusters now
+*/
+void progress_check(int live);
+
+/**
+*  Prints final line with total time
+*  @ingroup progress
+*/
+void progress_finish(void);
+
+/**
+*  Sets interval between reports
+*  @ingroup progress
+*  @param seconds interval in seconds
+*/
+void progress_interval(double seconds);
+
+#endif
@@ -8,500 +8,331 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
 #include <string.h>
-#include <ctype.h>
-#include <math.h>
 #include <limits.h>
 
-///@defgroup array Array operations
-///@defgroup cluster Cluster operations
-
-#ifdef NDEBUG
-#define debug(s)
-#define dfmt(s, ...)
-#define dint(i)
-#define dfloat(f)
-#else
-
-/// prints debug string
-#define debug(s) printf("- %s\n", s)
-
-/// prints formated debug output (using similar like printf)
-#define dfmt(s, ...) printf(" - "__FILE__":%u: "s"\n",__LINE__,__VA_ARGS__)
-
-/// prints debug information about variable
-#define dint(i) printf(" - " __FILE__ ":%u: " #i " = %d\n", __LINE__, i)
-
-/// prints debug inforamtion about variable float type
-#define dfloat(f) printf(" - " __FILE__ ":%u: " #f " = %g\n", __LINE__, f)
-
-#endif
-
-/// @struct obj_t
-struct obj_t {
-    int id;  ///< unique ID of object
-    float x; ///< x coordinate of object
-    float y; ///< y coordinate of object
-};
-
-/// @struct cluster_t
-struct cluster_t {
-    int size;           ///< number of objects in cluster
-    int capacity;       ///< maximum number of objects in cluster
-    struct obj_t *obj;  ///< array of objects in cluster
-};
+#include "alloc.h"
+#include "cluster.h"
+#include "stats.h"
+#include "perf.h"
+#include "trace.h"
+#include "engine.h"
+#include "kernel.h"
+#include "progress.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "mst.h"
+#include "score.h"
+#include "divisive.h"
+#include "bootstrap.h"
+#include "query.h"
+#include "numa.h"
 
 /**
-*  Init of cluster. Allocate memory for capacity of object
-*  pointer to NULL means zero capacity of array
-*  @ingroup cluster
-*  @param c pointer to cluster
-*  @param cap capacity of cluster
-*  @pre cluster can't point to NULL
-*  @pre capacity must be greater than one
+*  Main function
+*  @param argc number of arguments
+*  @param argv array of arguments
+*  @return zero if program is successful
 */
-void init_cluster(struct cluster_t *c, int cap)
+int main(int argc, char *argv[])
 {
-    assert(c != NULL);
-    assert(cap >= 0);
+    struct cluster_t *clusters;
+    int size;
+    int narr = 1;
+    char *trace = NULL;
+    int verify = 0;
+    int isa = 0;
+    int jobs = 1;
+    char *batch = NULL;
+    char *server = NULL;
+    char *insert = NULL;
+    int methods = 0;
+    int score_lo = 0, score_hi = 0;
+    int engine_given = 0;
+    int divisive = 0;
+    int bootstrap = 0;
+    char *query = NULL;
+    char *cpus = NULL;
+    int pin = 0;
+    struct engine_opts opts = { ENGINE_REF, METHOD_AVG, 1, NULL, NULL, NULL, NULL, 0 };
 
-    c->size = 0;
-    if (cap > 0)
-    {
-        if ((c->obj = malloc(cap * sizeof(struct obj_t))))
-            c->capacity = cap;
-        else
-            fprintf(stderr, "Memory allocation was not succeed\n");
-    }
-    else
+    if(argc < 2)
     {
-        c->capacity = 0;
-        c->obj = NULL;
-    }
-}
-
-/**
-*  Erase all objects in cluster and initialize
-*  @ingroup cluster
-*  cluster to empty cluster
-*  @param c pointer to cluster
-*/
-void clear_cluster(struct cluster_t *c)
-{
-    free(c->obj);
-    c->capacity = 0;
-    c->size = 0;
-    c->obj = NULL;
-}
-
-/// Chunk of cluster objects. Value recommended for reallocation.
-const int CLUSTER_CHUNK = 10;
-
-/**
-*  Change capacity of cluster
-*  @ingroup cluster
-*  @param c pointer to cluster
-*  @param new_cap new capacity
-*  @pre cluster can't point to NULL
-*  @pre cluster capacity must be greater than one
-*  @pre new capacity must be greater than zero
-*  @return pointer to resized structure
-*/
-struct cluster_t *resize_cluster(struct cluster_t *c, int new_cap)
-{
-    assert(c);
-    assert(c->capacity >= 0);
-    assert(new_cap >= 0);
-
-    if (c->capacity >= new_cap)
-        return c;
-
-    size_t size = sizeof(struct obj_t) * new_cap;
-
-    void *arr = realloc(c->obj, size);
-    if (arr == NULL)
-        return NULL;
-
-    c->obj = (struct obj_t*)arr;
-    c->capacity = new_cap;
-    return c;
-}
-
-/**
-*  @ingroup cluster
-*  Appends object to cluster, in case of full capacity, resizes cluster
-*  @param c pointer to cluster
-*  @param obj object
-*/
-void append_cluster(struct cluster_t *c, struct obj_t obj)
-{
-    int cap = c->capacity;
-    int size = c->size;
-    while (size >= cap)
-        cap += CLUSTER_CHUNK;
-
-    resize_cluster(c, cap);
-    c->obj[c->size++] = obj;
-}
-
-/*
- Seradi objekty ve shluku 'c' vzestupne podle jejich identifikacniho cisla.
- */
-void sort_cluster(struct cluster_t *c);
-
-/**
-*  Appends objects from one cluster to another, in case can be resized.
-*  After merge objects are sorted by id
-*  @ingroup cluster
-*  @param c1 pointer to cluster into which is appended
-*  @param c2 pointer to cluster which objects are appended
-*  @pre pointers c1 and c2 can't be NULL
-*/
-void merge_clusters(struct cluster_t *c1, struct cluster_t *c2)
-{
-    assert(c1 != NULL);
-    assert(c2 != NULL);
-
-    for (int i = 0; i < c2->size; i++)
-        append_cluster(c1, c2->obj[i]);
-
-    sort_cluster(c1);
-}
-
-/**********************************************************************/
-/* Array operations */
-
-
-/**
-*  Appends objects from one cluster to another, in case can be resized.
-*  After merge objects are sorted by id
-*  @ingroup array
-*  @param carr array of clusters
-*  @param narr number of clusters in array
-*  @param idx index in array which is removed
-*  @pre index of object must be lower than number of clusters in array
-*  @pre number of clusters in array must be greater than zero
-*  @return size of cluster after remove
-*/
-int remove_cluster(struct cluster_t *carr, int narr, int idx)
-{
-    assert(idx < narr);
-    assert(narr > 0);
-
-    while (idx < narr) {
-
-        clear_cluster(&carr[idx]);
-
-        // if index is last in array, no need to merge
-        if(idx != narr - 1)
-            merge_clusters(&carr[idx], &carr[idx + 1]);
-
-        idx++;
-
+        fprintf(stderr, "Filename is not set\n");
+        return -1;
     }
 
-    return narr - 1;
-
-}
-
-/**
-*  Euclides distance between two objects
-*  @ingroup cluster
-*  @param o1 pointer to object
-*  @param o2 pointer to object
-*  @pre objects o1 and o2 can't point to NULL
-*  @return euclides distance between two objects
-*/
-float obj_distance(struct obj_t *o1, struct obj_t *o2)
-{
-    assert(o1 != NULL);
-    assert(o2 != NULL);
-
-    float dist, a, b;
-
-    a = o1->x - o2->x;
-    b = o1->y - o2->y;
-
-    a *= a;
-    b *= b;
-
-    dist = sqrtf(a + b);
-
-    return dist;
-}
-
-/// Case value for choosing cluster distance method
-int premium_case;
-
-/**
-*  Calculate distance between two clusters by selected method
-*  @ingroup cluster
-*  @param c1 pointer to cluster
-*  @param c2 pointer to cluster
-*  @pre clusters c1 and c2 can't point to NULL
-*  @pre cluster size of cluster must be greater than zero
-*  @return distance between two clusters
-*/
-float cluster_distance(struct cluster_t *c1, struct cluster_t *c2)
-{
-    assert(c1 != NULL);
-    assert(c1->size > 0);
-    assert(c2 != NULL);
-    assert(c2->size > 0);
-
-    float result;
-
-    if(!premium_case)
+    if(!strncmp(argv[1], "--batch=", 8))
+        batch = argv[1] + 8;
+    else if(!strncmp(argv[1], "--serve=", 8))
+        server = argv[1] + 8;
+    else if(!strncmp(argv[1], "--connect=", 10))
     {
-
-        float object_distance = 0;
-        int object_count = 0;
-
-        for (int i = 0; i < c1->size; i++)
+        // request is the rest of arguments, answer is printed as is
+        char request[4096] = "";
+        for(int i = 2; i < argc; i++)
         {
-            for (int j = 0; j < c2->size; j++)
+            if(strlen(request) + strlen(argv[i]) + 2 > sizeof(request))
             {
-                object_distance += obj_distance(&c1->obj[i], &c2->obj[j]);
-                object_count++;
+                fprintf(stderr, "Request is too long\n");
+                return -1;
             }
+            if(i > 2)
+                strcat(request, " ");
+            strcat(request, argv[i]);
         }
-        result = object_distance / object_count;
+        return serve_request(argv[1] + 10, request);
     }
 
-    if(premium_case == 1)
+    for(int i = batch || server ? 2 : 3; i < argc; i++)
     {
-        float distance = obj_distance(&c1->obj[0], &c2->obj[0]);
-
-        for(int i = 0; i < c1->size; i++)
+        if(!strcmp(argv[i], "--avg"))
+            opts.method = METHOD_AVG;
+        else if(!strcmp(argv[i], "--min"))
+            opts.method = METHOD_MIN;
+        else if(!strcmp(argv[i], "--max"))
+            opts.method = METHOD_MAX;
+        else if(!strcmp(argv[i], "--ward"))
+            opts.method = METHOD_WARD;
+        else if(!strcmp(argv[i], "--centroid"))
+            opts.method = METHOD_CENTROID;
+        else if(!strcmp(argv[i], "--median"))
+            opts.method = METHOD_MEDIAN;
+        else if(!strcmp(argv[i], "--stats"))
+            stats.enabled = 1;
+        else if(!strcmp(argv[i], "--stats=json"))
+            stats.enabled = stats.json = 1;
+        else if(!strcmp(argv[i], "--perf"))
+            stats.perf = 1;
+        else if(!strncmp(argv[i], "--trace=", 8))
+            trace = argv[i] + 8;
+        else if(!strncmp(argv[i], "--engine=", 9))
         {
-            for(int j = 0; j < c2->size; j++)
+            if((opts.engine = engine_by_name(argv[i] + 9)) < 0)
             {
-                float new_distance = obj_distance(&c1->obj[i], &c2->obj[j]);
-
-                if(distance > new_distance)
-                    distance = new_distance;
+                fprintf(stderr, "Unknown engine\n");
+                return -1;
             }
+            engine_given = 1;
         }
-        result = distance;
-    }
-
-    if(premium_case == 2)
-    {
-        float distance = obj_distance(&c1->obj[0], &c2->obj[0]);
-
-        for(int i = 0; i < c1->size; i++)
+        else if(!strncmp(argv[i], "--threads=", 10))
         {
-            for(int j = 0; j < c2->size; j++)
+            if((opts.threads = atoi(argv[i] + 10)) < 1)
             {
-                float new_distance = obj_distance(&c1->obj[i], &c2->obj[j]);
-
-                if(distance < new_distance)
-                    distance = new_distance;
+                fprintf(stderr, "Invalid thread count\n");
+                return -1;
             }
         }
-        result = distance;
-    }
-
-    return result;
-}
-
-/**
-*  Searching for two closest clusters in array
-*  and saves their indexes
-*  @ingroup array
-*  @param carr array of clusters
-*  @param narr count of clusters in array
-*  @param c1 pointer for saving first cluster
-*  @param c2 pointer for saving second cluster
-*  @pre number of clusters in array must be greater than zero
-*/
-void find_neighbours(struct cluster_t *carr, int narr, int *c1, int *c2)
-{
-    assert(narr > 0);
-    float distance, new_dist;
-    distance = cluster_distance(&carr[0], &carr[1]);
-
-    for (int i = 0; i < narr; i++) {
-        for (int j = i + 1; j < narr; j++)
+        else if(!strncmp(argv[i], "--cpus=", 7))
+            cpus = argv[i] + 7;
+        else if(!strcmp(argv[i], "--pin"))
+            pin = 1;
+        else if(!strcmp(argv[i], "--thp"))
+            numa_hugepages = 1;
+        else if(!strncmp(argv[i], "--isa=", 6))
         {
-            new_dist = cluster_distance(&carr[i], &carr[j]);
-            if(distance >= new_dist)
+            if(!kernel_select(isa_by_name(argv[i] + 6)))
             {
-                distance = new_dist;
-                *c1 = i;
-                *c2 = j;
+                fprintf(stderr, "Instruction set is unknown or not supported\n");
+                return -1;
             }
+            isa = 1;
         }
-    }
-}
-
-/**
-*  Function for easier sorting
-*  @ingroup cluster
-*  @param a pointer to void
-*  @param b pointer to void
-*  @return Zero if compare is succeed
-*/
-static int obj_sort_compar(const void *a, const void *b)
-{
-    const struct obj_t *o1 = (const struct obj_t *)a;
-    const struct obj_t *o2 = (const struct obj_t *)b;
-    if (o1->id < o2->id) return -1;
-    if (o1->id > o2->id) return 1;
-    return 0;
-}
-
-/**
-*  Sorting cluster by id ASC
-*  @ingroup cluster
-*  @param c pointer to cluster which is sorted
-*/
-void sort_cluster(struct cluster_t *c)
-{
-    qsort(c->obj, c->size, sizeof(struct obj_t), &obj_sort_compar);
-}
-
-/**
-*  Prints cluster to stdout
-*  @ingroup array
-*  @param c pointer to cluster which is printed
-*/
-void print_cluster(struct cluster_t *c)
-{
-    for (int i = 0; i < c->size; i++)
-    {
-        if (i) putchar(' ');
-        printf("%d[%g,%g]", c->obj[i].id, c->obj[i].x, c->obj[i].y);
-    }
-    putchar('\n');
-}
-
-/**
-*  Loads objects from file, for each object creates cluster and inserts
-*  it into an array of clusters. Also allocate space for array of Clusters
-*  and pointer on first item in array saves to memory
-*  @ingroup array
-*  @param filename name of file from which are object loaded
-*  @param arr pointer on array of clusters
-*  @pre arr can't point to NULL
-*  @return number of clusters in file
-*/
-int load_clusters(char *filename, struct cluster_t **arr)
-{
-    assert(arr != NULL);
-    int lineNumber = 0;
-    FILE *file = fopen(filename, "r");
-    char line[100];
-    int count;
-    int id;
-    float x,y;
-    struct obj_t object;
-
-    if(!file)
-    {
-        fprintf(stderr, "File not found\n");
-        return 0;
-    }
-
-    while (fgets(line, sizeof(line), file))
-    {
-        if(lineNumber == 0)
+        else if(!strncmp(argv[i], "--metric=", 9))
         {
-
-            if(sscanf(line, "count=%d", &count) == 0)
+            int metric = metric_by_name(argv[i] + 9);
+            if(metric < 0)
             {
-                fprintf(stderr, "Invalid format for cluster count in file\n");
-                return 0;
+                fprintf(stderr, "Unknown metric\n");
+                return -1;
             }
-
-            if(count < 1)
+            kernel_select_metric(metric);
+        }
+        else if(!strcmp(argv[i], "--progress"))
+            progressing = 1;
+        else if(!strncmp(argv[i], "--progress=", 11))
+        {
+            char *fail;
+            double interval = strtod(argv[i] + 11, &fail);
+            if(*fail || interval <= 0)
             {
-                fprintf(stderr, "Invalid format or value for cluster count in file\n");
-                return 0;
+                fprintf(stderr, "Invalid progress interval\n");
+                return -1;
             }
-
-            *arr = malloc(sizeof(struct cluster_t) * count);
-
+            progress_interval(interval);
+            progressing = 1;
         }
-        else
+        else if(!strncmp(argv[i], "--cache=", 8))
+            cache_dir = argv[i] + 8;
+        else if(!strncmp(argv[i], "--cache-size=", 13))
         {
-            init_cluster(&(*arr)[lineNumber - 1], 1);
-
-            if(sscanf(line, "%d %f %f\n", &id, &x, &y) < 3)
+            char *fail;
+            double mb = strtod(argv[i] + 13, &fail);
+            if(*fail || mb <= 0)
             {
-                fprintf(stderr, "Data are invalid\n");
-                return 0;
+                fprintf(stderr, "Invalid cache size\n");
+                return -1;
             }
-
-            if(0 > y || y > 1000 || 0 > x || x > 1000)
+            cache_limit = mb * (1 << 20);
+        }
+        else if(!strncmp(argv[i], "--methods=", 10))
+        {
+            // names are matched in place, a list of any length fits
+            for(const char *name = argv[i] + 10; ; name++)
             {
-                fprintf(stderr, "Data are invalid\n");
-                return 0;
+                size_t len = strcspn(name, ",");
+                int m = METHOD_COUNT;
+                while(--m >= 0)
+                    if(strlen(method_names[m]) == len && !strncmp(name, method_names[m], len))
+                        break;
+                if(m < 0)
+                {
+                    fprintf(stderr, "Unknown method\n");
+                    return -1;
+                }
+                methods |= 1 << m;
+                name += len;
+                if(!*name)
+                    break;
+            }
+        }
+        else if(!strncmp(argv[i], "--score-cuts=", 13))
+        {
+            char rest;
+            if(sscanf(argv[i] + 13, "%d..%d%c", &score_lo, &score_hi, &rest) != 2 ||
+               score_lo < 2 || score_hi < score_lo)
+            {
+                fprintf(stderr, "Invalid range of cuts\n");
+                return -1;
             }
-
-            object.id = id;
-            object.x = x;
-            object.y = y;
-            append_cluster(&(*arr)[lineNumber - 1], object);
         }
-        lineNumber++;
+        else if(!strncmp(argv[i], "--insert=", 9))
+            insert = argv[i] + 9;
+        else if(!strcmp(argv[i], "--divisive"))
+            divisive = 1;
+        else if(!strncmp(argv[i], "--bootstrap=", 12))
+        {
+            char *fail;
+            bootstrap = strtol(argv[i] + 12, &fail, 10);
+            if(*fail || bootstrap < 1)
+            {
+                fprintf(stderr, "Invalid resample count\n");
+                return -1;
+            }
+        }
+        else if(!strncmp(argv[i], "--query=", 8))
+        {
+            // every entry is one integer id, empty entries are not allowed
+            query = argv[i] + 8;
+            int valid = query[strspn(query, "-0123456789,")] == '\0';
+            for(const char *p = query; valid; p++)
+            {
+                char *end;
+                long id = strtol(p, &end, 10);
+                valid = end != p && id >= INT_MIN && id <= INT_MAX && (*end == ',' || *end == '\0');
+                if(*(p = end) == '\0')
+                    break;
+            }
+            if(!valid)
+            {
+                fprintf(stderr, "Invalid list of ids\n");
+                return -1;
+            }
+        }
+        else if(!strcmp(argv[i], "--verify"))
+            verify = 1;
+        else if((batch || server) && !strncmp(argv[i], "--jobs=", 7))
+        {
+            if((jobs = atoi(argv[i] + 7)) < 1)
+            {
+                fprintf(stderr, "Invalid job count\n");
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Invalid argument of program\n");
+            return -1;
+        }
     }
 
-    if(lineNumber != count + 1)
+    if(!isa)
+        kernel_select(isa_by_name("auto"));
+
+    // affinity is inherited by every thread started later
+    if((cpus || pin) && !numa_init(cpus, pin))
     {
-        fprintf(stderr, "Count of clusters is not equal as number in count paramteter\n");
-        return 0;
+        fprintf(stderr, "Invalid CPU list\n");
+        return -1;
     }
 
-    fclose(file);
-    return count;
-}
+    // methods computed from centroids have O(n) memory engines
+    if(!engine_given)
+        opts.engine = engine_for_method(ENGINE_REF, opts.method);
 
-/**
-*  Prints array of clusters to stdout
-*  @param carr array of clusters
-*  @param narr count of clusters in array
-*/
-void print_clusters(struct cluster_t *carr, int narr)
-{
-    printf("Clusters:\n");
-    for (int i = 0; i < narr; i++)
+    // splits aren't merges of the hierarchy that other modes compare or keep
+    if(divisive && (verify || cache_dir || insert || methods || score_hi || batch || server))
     {
-        printf("cluster %d: ", i);
-        print_cluster(&carr[i]);
+        fprintf(stderr, "Divisive mode supports only clusters of one file without --verify and --cache\n");
+        return -1;
     }
-}
 
-/**
-*  Main function
-*  @param argc number of arguments
-*  @param argv array of arguments
-*  @return zero if program is successful
-*/
-int main(int argc, char *argv[])
-{
-    struct cluster_t *clusters;
-    int size;
-    int narr = 1;
+    // every resample is a run of its own, reports of one run don't apply
+    if(bootstrap && (stats.enabled || stats.perf || trace || progressing || verify || cache_dir ||
+                     insert || methods || score_hi || divisive || batch || server))
+    {
+        fprintf(stderr, "Option is not supported with --bootstrap\n");
+        return -1;
+    }
 
-    if(argc < 2)
+    // answers come from the recorded dendrogram, not from the loop
+    if(query && (stats.enabled || stats.perf || trace || progressing || verify || insert ||
+                 methods || score_hi || divisive || bootstrap || batch || server))
     {
-        fprintf(stderr, "Filename is not set\n");
+        fprintf(stderr, "Option is not supported with --query\n");
         return -1;
     }
 
-    if(argc > 3)
+    if(batch)
     {
+        // reports of single run are not meaningful for concurrent jobs
+        if(stats.enabled || stats.perf || trace || progressing || verify || insert || methods || score_hi)
+        {
+            fprintf(stderr, "Option is not supported in batch mode\n");
+            return -1;
+        }
+        return batch_run(batch, jobs, &opts) ? -1 : 0;
+    }
 
-        premium_case = 0;
+    // runs of methods are concurrent, reports of one run don't apply
+    if(methods && (stats.enabled || stats.perf || trace || progressing || cache_dir || insert))
+    {
+        fprintf(stderr, "Option is not supported with --methods\n");
+        return -1;
+    }
 
-        if(!strcmp(argv[3], "--min"))
-            premium_case = 1;
+    if(score_hi && (stats.enabled || stats.perf || trace || progressing || verify || insert || methods))
+    {
+        fprintf(stderr, "Option is not supported with --score-cuts\n");
+        return -1;
+    }
 
-        if(!strcmp(argv[3], "--max"))
-            premium_case = 2;
+    // tree answers only single linkage, objects of file are new objects
+    if(insert && (opts.method != METHOD_MIN || verify || cache_dir || kernel_metric() != METRIC_EUCLIDEAN))
+    {
+        fprintf(stderr, "Incremental mode supports only --min without --verify, --cache and --metric\n");
+        return -1;
+    }
 
+    if(server)
+    {
+        if(stats.enabled || stats.perf || trace || progressing || verify || insert || methods || score_hi)
+        {
+            fprintf(stderr, "Option is not supported in server mode\n");
+            return -1;
+        }
+        return serve(server, jobs, &opts);
     }
 
     if(argc > 2)
@@ -521,35 +352,192 @@ int main(int argc, char *argv[])
         }
     }
 
+    stats.timing = stats.enabled || stats.perf;
+    if(stats.perf)
+        stats.perf = perf_open();
+
+    if(trace && !trace_open(trace))
+        return -1;
+
+    double t[4];
+    t[0] = stats_now();
+
+    stats_begin(PHASE_LOAD);
     size = load_clusters(argv[1], &clusters);
+    stats_end(PHASE_LOAD);
+
+    if(tracing)
+        trace_span("load", "phase", t[0], stats_now(), NULL);
 
     if(size == 0)
     {
+        // failed run still leaves a complete trace
+        if(tracing)
+            trace_close();
         return -1;
     }
 
-    if(narr > size && size != 0)
+    // objects of more than two coordinates share one block of coordinates
+    float *coords = CLUSTER_OBJ(&clusters[0])[0].v;
+
+    // scores are of the range of cuts, N is not used
+    if(score_hi)
+    {
+        int failed = score_run(clusters, size, score_lo, score_hi, &opts);
+        xfree(coords);
+        return failed;
+    }
+
+    if(narr > size && !insert)
     {
         fprintf(stderr, "Argument is greater that count of clusters\n");
+        if(tracing)
+            trace_close();
         return -1;
     }
 
-    int c1,c2;
+    if(bootstrap)
+    {
+        int failed = bootstrap_run(clusters, size, narr, bootstrap, &opts);
+        xfree(coords);
+        return failed;
+    }
 
-    while(size > narr)
+    if(query)
     {
-        find_neighbours(clusters, size, &c1, &c2);
-        merge_clusters(&clusters[c1], &clusters[c2]);
-        remove_cluster(clusters, size, c2);
-        size--;
+        int failed = query_run(clusters, size, narr, query, &opts);
+        xfree(coords);
+        return failed;
     }
 
+    struct cluster_t *reference = NULL;
+
+    if(methods)
+    {
+        struct cluster_t *out[METHOD_COUNT];
+        int count[METHOD_COUNT];
+        int failed = engine_run_methods(clusters, size, narr, &opts, methods, out, count);
+
+        for(int m = 0; m < METHOD_COUNT; m++)
+        {
+            if(out[m] == NULL)
+                continue;
+
+            printf("Method %s:\n", method_names[m]);
+            print_clusters(out[m], count[m]);
+
+            if(verify && (reference = copy_clusters(clusters, size)))
+            {
+                opts.engine = ENGINE_REF;
+                opts.method = m;
+                engine_run(reference, size, narr, &opts);
+                int diff = compare_clusters(out[m], reference, count[m]);
+                if(diff >= 0)
+                {
+                    fprintf(stderr, "Verify failed: cluster %d of --%s differs from reference\n",
+                            diff, method_names[m]);
+                    failed = -1;
+                }
+                for(int i = 0; i < count[m]; i++)
+                    clear_cluster(&reference[i]);
+                xfree(reference);
+            }
+            else if(verify)
+                failed = -1;
+
+            for(int i = 0; i < count[m]; i++)
+                clear_cluster(&out[m][i]);
+            xfree(out[m]);
+        }
+
+        for(int i = 0; i < size; i++)
+            clear_cluster(&clusters[i]);
+        xfree(clusters);
+        xfree(coords);
+        return failed;
+    }
+
+    int count = size;
+
+    if(verify && !(reference = copy_clusters(clusters, size)))
+    {
+        fprintf(stderr, "Memory allocation was not succeed\n");
+        if(tracing)
+            trace_close();
+        return -1;
+    }
+
+    double loop_start = stats_now();
+
+    if(tracing)
+        trace_iterations(size - narr);
+
+    if(insert)
+        size = mst_run(insert, &clusters, size, narr);
+    else if(divisive)
+        size = divisive_run(clusters, size, narr, opts.method);
+    else if(cache_dir)
+        size = cache_run(&clusters, size, narr, &opts);
+    else
+        size = engine_run(clusters, size, narr, &opts);
+
+    if(size < 0)
+    {
+        if(tracing)
+        {
+            trace_span("cluster", "phase", loop_start, stats_now(), NULL);
+            trace_close();
+        }
+        return -1;
+    }
+
+    if(tracing)
+    {
+        trace_span("cluster", "phase", loop_start, stats_now(), NULL);
+        t[0] = stats_now();
+    }
+
+    stats_begin(PHASE_PRINT);
     print_clusters(clusters, size);
+    stats_end(PHASE_PRINT);
+
+    if(tracing)
+    {
+        fflush(stdout);
+        trace_span("print", "phase", t[0], stats_now(), NULL);
+        trace_close();
+    }
+
+    if(stats.enabled)
+        stats_report();
+
+    if(stats.perf)
+        perf_report();
+
+    if(verify)
+    {
+        // reference run must not be counted in stats of the engine
+        stats.enabled = stats.timing = tracing = progressing = 0;
+        opts.engine = ENGINE_REF;
+        engine_run(reference, count, narr, &opts);
+
+        int diff = compare_clusters(clusters, reference, size);
+        if(diff >= 0)
+            fprintf(stderr, "Verify failed: cluster %d differs from reference\n", diff);
+
+        for(int i = 0; i < size; i++)
+            clear_cluster(&reference[i]);
+        xfree(reference);
+
+        if(diff >= 0)
+            return -1;
+    }
 
     for(int i = 0; i < size; i++)
         clear_cluster(&clusters[i]);
 
-    free(clusters);
+    xfree(clusters);
+    xfree(coords);
 
     return 0;
 }
@@ -0,0 +1,201 @@
+/*
+*
+*  @brief     Membership queries
+*  @details   Cluster of an object and its co-members at any N from a
+*             recorded dendrogram
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "cache.h"
+#include "query.h"
+
+/**
+*  Slot of id in hash table
+*  @ingroup query
+*  @param id id of object
+*  @param mask size of table minus one
+*  @return first slot to probe
+*/
+static unsigned query_hash(int id, unsigned mask)
+{
+    unsigned h = (unsigned)id * 0x9E3779B1u;
+    return (h ^ h >> 16) & mask;
+}
+
+int query_init(struct query_index *q, const struct dendro *d, const struct obj_t *obj)
+{
+    int n = d->n;
+
+    q->up = NULL;
+    q->table = NULL;
+    if (!dendro_layout_init(&q->layout, d, obj))
+        return 0;
+
+    q->nodes = n + d->count;
+    q->levels = 1;
+    while ((1 << (q->levels - 1)) < q->nodes)
+        q->levels++;
+
+    // table is at most half full, so probes stay short
+    unsigned cap = 2;
+    while (cap < 2 * (unsigned)n)
+        cap *= 2;
+    q->mask = cap - 1;
+
+    q->up = xmalloc(sizeof(int) * q->levels * q->nodes);
+    q->table = xmalloc(sizeof(int) * cap);
+    if (q->up == NULL || q->table == NULL)
+    {
+        query_free(q);
+        return 0;
+    }
+
+    int *up = q->up;
+    for (int x = 0; x < q->nodes; x++)
+        up[x] = x;
+    for (int m = 0; m < d->count; m++)
+        up[q->layout.child[2 * m]] = up[q->layout.child[2 * m + 1]] = n + m;
+    for (int j = 1; j < q->levels; j++)
+        for (int x = 0; x < q->nodes; x++)
+            up[j * q->nodes + x] = up[(j - 1) * q->nodes + up[(j - 1) * q->nodes + x]];
+
+    // first object of an id is found, like the first line of the id in file
+    memset(q->table, -1, sizeof(int) * cap);
+    for (int p = 0; p < n; p++)
+    {
+        unsigned h = query_hash(obj[p].id, q->mask);
+        while (q->table[h] >= 0 && obj[q->table[h]].id != obj[p].id)
+            h = (h + 1) & q->mask;
+        if (q->table[h] < 0)
+            q->table[h] = p;
+    }
+    return 1;
+}
+
+void query_free(struct query_index *q)
+{
+    dendro_layout_free(&q->layout);
+    xfree(q->up);
+    xfree(q->table);
+    q->up = NULL;
+    q->table = NULL;
+}
+
+int query_position(const struct query_index *q, int id)
+{
+    const struct dendro_layout *l = &q->layout;
+    unsigned h = query_hash(id, q->mask);
+
+    // objects are in leaf order, position p is at start of its leaf
+    for (; q->table[h] >= 0; h = (h + 1) & q->mask)
+        if (l->obj[l->start[q->table[h]]].id == id)
+            return q->table[h];
+    return -1;
+}
+
+int query_cluster(const struct query_index *q, int id, int narr)
+{
+    int n = q->layout.n, k = n - narr;
+    int x = query_position(q, id);
+
+    if (x < 0)
+        return -1;
+
+    // climbs while the ancestor is made by one of the first k merges
+    for (int j = q->levels - 1; j >= 0; j--)
+    {
+        int a = q->up[j * q->nodes + x];
+        if (a >= n && a - n < k)
+            x = a;
+    }
+    return x;
+}
+
+const struct obj_t *query_members(const struct query_index *q, int node, int *size)
+{
+    *size = q->layout.size[node];
+    return q->layout.obj + q->layout.start[node];
+}
+
+int query_run(struct cluster_t *carr, int size, int narr, const char *ids, const struct engine_opts *opts)
+{
+    struct engine_opts o = *opts;
+    struct obj_t *obj = xmalloc(sizeof(struct obj_t) * size);
+    struct dendro d = { 0, 0, NULL };
+    struct query_index q;
+    int ok = obj != NULL;
+    int left = size;
+
+    for (int i = 0; ok && i < size; i++)
+    {
+        ok = carr[i].size == 1;
+        obj[i] = CLUSTER_OBJ(&carr[i])[0];
+    }
+
+    uint64_t key = ok && cache_dir ? cache_key(obj, size) : 0;
+    if (ok && !(cache_dir && cache_load(key, obj, size, opts->method, &d)))
+    {
+        o.dendro = &d;
+        if ((ok = dendro_init(&d, size)))
+        {
+            if (!(ok = (left = engine_run(carr, size, 1, &o)) >= 0))
+            {
+                left = 0;
+                dendro_free(&d);
+            }
+            else if (cache_dir && !cache_store(key, obj, opts->method, &d))
+                fprintf(stderr, "Result can't be stored in cache\n");
+        }
+    }
+
+    for (int i = 0; i < left; i++)
+        clear_cluster(&carr[i]);
+    xfree(carr);
+
+    if (ok && !(ok = query_init(&q, &d, obj)))
+        fprintf(stderr, "Memory allocation was not succeed\n");
+
+    for (const char *p = ids; ok && *p; )
+    {
+        char *end;
+        int id = strtol(p, &end, 10);
+        int entry = end != p && (*end == ',' || *end == '\0');
+
+        // entries which aren't ids are skipped, later ones are still answered
+        p = end + strcspn(end, ",");
+        p += *p == ',';
+        if (!entry)
+            continue;
+
+        int node = query_cluster(&q, id, narr);
+        if (node < 0)
+        {
+            printf("object %d: not found\n", id);
+            continue;
+        }
+
+        int count;
+        const struct obj_t *m = query_members(&q, node, &count);
+        struct cluster_t c;
+        init_cluster(&c, count);
+        for (int i = 0; i < count; i++)
+            append_cluster(&c, m[i]);
+        sort_cluster(&c);
+
+        printf("object %d: node %d, %d objects\n", id, node, count);
+        print_cluster(&c);
+        clear_cluster(&c);
+    }
+
+    if (ok)
+        query_free(&q);
+    if (d.merges)
+        dendro_free(&d);
+    xfree(obj);
+    return ok ? 0 : -1;
+}
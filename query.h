@@ -0,0 +1,99 @@
+/*
+*
+*  @brief     Membership queries
+*  @details   Cluster of an object and its co-members at any N from a
+*             recorded dendrogram
+*  @author    Matej Soroka
+*
+*/
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "engine.h"
+
+///@defgroup query Membership queries
+
+/*
+ Nodes of dendro_layout form the merge tree, node n + m is made by merge m,
+ so merges on the path from a leaf to its root only get later. The cluster
+ of a position at N is its highest ancestor made by one of the first n - N
+ merges. Ancestors 1, 2, 4, ... levels up of every node are kept, so the
+ ancestor is found by binary lifting in O(log n). Objects are found by id
+ in a hash table of positions. Members of the found node are one range of
+ objects in leaf order. A node stays the same cluster for every N from its
+ merge until it is merged again, so it identifies the cluster across N.
+*/
+
+/// @struct query_index
+struct query_index {
+    struct dendro_layout layout;  ///< leaf order and ranges of nodes
+    int nodes;                    ///< number of nodes, n + count
+    int levels;                   ///< number of kept ancestor levels
+    int *up;                      ///< up[j * nodes + x] is ancestor 2^j levels
+                                  ///< above x, the root is its own ancestor
+    int *table;                   ///< positions by hash of id, -1 if empty
+    unsigned mask;                ///< size of table minus one
+};
+
+/**
+*  Builds index of dendrogram
+*  @ingroup query
+*  @param q index
+*  @param d dendrogram
+*  @param obj objects in order of positions
+*  @return nonzero if memory was allocated
+*/
+int query_init(struct query_index *q, const struct dendro *d, const struct obj_t *obj);
+
+/**
+*  Frees memory of index
+*  @ingroup query
+*  @param q index
+*/
+void query_free(struct query_index *q);
+
+/**
+*  Finds position of object
+*  @ingroup query
+*  @param q index
+*  @param id id of object
+*  @return position or -1 if no object has the id
+*/
+int query_position(const struct query_index *q, int id);
+
+/**
+*  Finds cluster of object in cut with narr clusters in O(log n)
+*  @ingroup query
+*  @param q index
+*  @param id id of object
+*  @param narr number of clusters
+*  @pre narr must be between n - count and n
+*  @return node of cluster or -1 if no object has the id
+*/
+int query_cluster(const struct query_index *q, int id, int narr);
+
+/**
+*  Members of node, objects are in leaf order
+*  @ingroup query
+*  @param q index
+*  @param node node of cluster
+*  @param size pointer for number of members
+*  @return first member
+*/
+const struct obj_t *query_members(const struct query_index *q, int node, int *size);
+
+/**
+*  Records dendrogram of loaded singletons (from cache if it is used) and
+*  prints cluster and co-members of every object of list at narr clusters
+*  @ingroup query
+*  @param carr array of loaded singletons, it is freed
+*  @param size number of clusters in array
+*  @param narr number of clusters
+*  @param ids comma separated ids of objects, entries which aren't ids
+*         are skipped
+*  @param opts engine, method and threads
+*  @return zero or -1 on error
+*/
+int query_run(struct cluster_t *carr, int size, int narr, const char *ids, const struct engine_opts *opts);
+
+#endif
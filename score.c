@@ -0,0 +1,609 @@
+/*
+*
+*  @brief     Cut scores
+*  @details   Silhouette, Calinski-Harabasz and Davies-Bouldin index of
+*             every cut of dendrogram in a range of N
+*  @author    Matej Soroka
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "cache.h"
+#include "score.h"
+#include "numa.h"
+
+/// Merge of two clusters of cut, b is merged into a
+struct cut_merge {
+    int a;  ///< cluster which stays
+    int b;  ///< cluster merged into a
+};
+
+/// Arguments of silhouette worker
+struct silhouette {
+    const float *dist;           ///< condensed distances of objects
+    int n;                       ///< number of objects
+    int k;                       ///< number of clusters of first cut
+    const int *cl;               ///< cluster of object in first cut
+    const struct cut_merge *mg;  ///< merges between consecutive cuts
+    int steps;                   ///< number of merges
+    int first;                   ///< first object of worker
+    int last;                    ///< object after last object of worker
+    double *sum;                 ///< sums of silhouette of objects by step
+    int failed;                  ///< memory can't be allocated
+};
+
+/**
+*  Distance of two objects in condensed matrix
+*  @ingroup score
+*  @param dist condensed matrix
+*  @param n number of objects
+*  @param i object
+*  @param j other object
+*  @return distance
+*/
+static inline float pair_dist(const float *dist, size_t n, size_t i, size_t j)
+{
+    if (i > j)
+    {
+        size_t t = i;
+        i = j;
+        j = t;
+    }
+    return dist[i * (2 * n - i - 1) / 2 + (j - i - 1)];
+}
+
+/**
+*  Sums silhouette of objects of worker for every cut
+*  @ingroup score
+*  @param arg pointer to struct silhouette
+*  @return NULL
+*/
+static void *silhouette_rows(void *arg)
+{
+    struct silhouette *s = arg;
+    int rows = s->last - s->first, k = s->k;
+    int pinned = numa_pin();
+    double *sums = xmalloc(sizeof(double) * rows * k);
+    int *own = xmalloc(sizeof(int) * (rows + 2 * k));
+
+    if (sums == NULL || own == NULL)
+    {
+        xfree(sums);
+        xfree(own);
+        s->failed = 1;
+        numa_unpin(pinned);
+        return NULL;
+    }
+
+    int *size = own + rows;
+    int *live = size + k;
+    int nlive = k;
+
+    memset(sums, 0, sizeof(double) * rows * k);
+    memset(size, 0, sizeof(int) * k);
+    for (int j = 0; j < s->n; j++)
+        size[s->cl[j]]++;
+    for (int c = 0; c < k; c++)
+        live[c] = c;
+
+    // sums of distances to clusters of the first cut, later cuts only add
+    // columns of merged clusters
+    for (int r = 0; r < rows; r++)
+    {
+        int i = s->first + r;
+        double *row = sums + (size_t)r * k;
+        own[r] = s->cl[i];
+        for (int j = 0; j < s->n; j++)
+            if (j != i)
+                row[s->cl[j]] += pair_dist(s->dist, s->n, i, j);
+    }
+
+    for (int step = 0; step <= s->steps; step++)
+    {
+        double total = 0;
+        for (int r = 0; r < rows; r++)
+        {
+            double *row = sums + (size_t)r * k;
+            int c = own[r];
+            if (size[c] == 1)
+                continue;
+
+            double a = row[c] / (size[c] - 1), b = INFINITY;
+            for (int l = 0; l < nlive; l++)
+                if (live[l] != c && row[live[l]] / size[live[l]] < b)
+                    b = row[live[l]] / size[live[l]];
+
+            double m = a > b ? a : b;
+            if (m > 0)
+                total += (b - a) / m;
+        }
+        s->sum[step] = total;
+
+        if (step == s->steps)
+            break;
+
+        int ca = s->mg[step].a, cb = s->mg[step].b;
+        for (int r = 0; r < rows; r++)
+        {
+            double *row = sums + (size_t)r * k;
+            row[ca] += row[cb];
+            if (own[r] == cb)
+                own[r] = ca;
+        }
+        size[ca] += size[cb];
+        for (int l = 0; l < nlive; l++)
+            if (live[l] == cb)
+            {
+                live[l] = live[--nlive];
+                break;
+            }
+    }
+
+    xfree(sums);
+    xfree(own);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+/// Sums of cluster for Calinski-Harabasz and Davies-Bouldin
+struct cut_cluster {
+    int size;         ///< number of objects
+    double *s;        ///< sums of every coordinate
+    double sq;        ///< sum of squared norms
+    double scatter;   ///< mean distance of objects to centroid
+    double worst;     ///< highest Davies-Bouldin ratio to other cluster
+    int partner;      ///< cluster of the highest ratio, -1 if none
+    int head;         ///< first object
+    int tail;         ///< last object
+};
+
+/// Arguments of Calinski-Harabasz and Davies-Bouldin worker
+struct cut_indices {
+    const struct obj_t *obj;     ///< objects in order of positions
+    int n;                       ///< number of objects
+    int k;                       ///< number of clusters of first cut
+    const int *cl;               ///< cluster of object in first cut
+    const struct cut_merge *mg;  ///< merges between consecutive cuts
+    int steps;                   ///< number of merges
+    struct cut_score *out;       ///< out[steps - s] is cut after s merges
+    int failed;                  ///< memory can't be allocated
+};
+
+/**
+*  Coordinate of object
+*  @ingroup score
+*  @param o object
+*  @param k index of coordinate
+*  @return coordinate
+*/
+static inline double obj_coord(const struct obj_t *o, int k)
+{
+    return o->dim > 2 ? o->v[k] : k ? o->y : o->x;
+}
+
+/**
+*  Sum of squared distances of objects of cluster to its centroid
+*  @ingroup score
+*  @param c cluster
+*  @param dim number of coordinates
+*  @return within group sum of squares
+*/
+static double cut_wgss(const struct cut_cluster *c, int dim)
+{
+    double ss = 0;
+    for (int k = 0; k < dim; k++)
+        ss += c->s[k] * c->s[k];
+    return c->sq - ss / c->size;
+}
+
+/**
+*  Computes mean distance of objects of cluster to its centroid
+*  @ingroup score
+*  @param c cluster
+*  @param obj objects
+*  @param next next object of the same cluster, -1 at the end
+*  @param dim number of coordinates
+*/
+static void cut_scatter(struct cut_cluster *c, const struct obj_t *obj, const int *next, int dim)
+{
+    double sum = 0;
+
+    for (int i = c->head; i >= 0; i = next[i])
+    {
+        double d2 = 0;
+        for (int k = 0; k < dim; k++)
+        {
+            double d = obj_coord(&obj[i], k) - c->s[k] / c->size;
+            d2 += d * d;
+        }
+        sum += sqrt(d2);
+    }
+    c->scatter = sum / c->size;
+}
+
+/**
+*  Davies-Bouldin ratio of two clusters, sum of their scatters over the
+*  distance of their centroids
+*  @ingroup score
+*  @param ci cluster
+*  @param cj other cluster
+*  @param dim number of coordinates
+*  @return ratio, infinity for equal centroids
+*/
+static double cut_ratio(const struct cut_cluster *ci, const struct cut_cluster *cj, int dim)
+{
+    double d2 = 0;
+    for (int l = 0; l < dim; l++)
+    {
+        double dl = ci->s[l] / ci->size - cj->s[l] / cj->size;
+        d2 += dl * dl;
+    }
+    double d = sqrt(d2);
+    return d > 0 ? (ci->scatter + cj->scatter) / d : INFINITY;
+}
+
+/**
+*  Finds highest ratio of cluster to other live clusters
+*  @ingroup score
+*  @param c clusters
+*  @param i cluster
+*  @param live live clusters
+*  @param nlive number of live clusters
+*  @param dim number of coordinates
+*/
+static void cut_worst(struct cut_cluster *c, int i, const int *live, int nlive, int dim)
+{
+    c[i].worst = 0;
+    c[i].partner = -1;
+    for (int j = 0; j < nlive; j++)
+    {
+        if (live[j] == i)
+            continue;
+        double r = cut_ratio(&c[i], &c[live[j]], dim);
+        if (c[i].partner < 0 || r > c[i].worst)
+        {
+            c[i].worst = r;
+            c[i].partner = live[j];
+        }
+    }
+}
+
+/**
+*  Computes Calinski-Harabasz and Davies-Bouldin index of every cut. Highest
+*  ratio of every cluster is kept, a merge of b into a computes ratios of a
+*  to all clusters, other clusters search all their ratios again only if
+*  their highest one was to a or b.
+*  @ingroup score
+*  @param arg pointer to struct cut_indices
+*  @return NULL
+*/
+static void *cut_indices_run(void *arg)
+{
+    struct cut_indices *ix = arg;
+    const struct obj_t *obj = ix->obj;
+    int n = ix->n, k = ix->k, dim = obj[0].dim;
+    int pinned = numa_pin();
+    struct cut_cluster *c = xmalloc(sizeof(struct cut_cluster) * k);
+    double *cs = xmalloc(sizeof(double) * (k + 1) * dim);
+    int *next = xmalloc(sizeof(int) * (n + k));
+
+    if (c == NULL || cs == NULL || next == NULL)
+    {
+        xfree(c);
+        xfree(cs);
+        xfree(next);
+        ix->failed = 1;
+        numa_unpin(pinned);
+        return NULL;
+    }
+
+    int *live = next + n;
+    double *ts = cs + (size_t)k * dim, tq = 0, tt = 0;
+    memset(cs, 0, sizeof(double) * (k + 1) * dim);
+    for (int j = 0; j < k; j++)
+    {
+        memset(&c[j], 0, sizeof(c[j]));
+        c[j].s = cs + (size_t)j * dim;
+        c[j].head = c[j].tail = -1;
+        live[j] = j;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        struct cut_cluster *ci = &c[ix->cl[i]];
+        double q = 0;
+        for (int l = 0; l < dim; l++)
+        {
+            double x = obj_coord(&obj[i], l);
+            ci->s[l] += x;
+            ts[l] += x;
+            q += x * x;
+        }
+        ci->size++;
+        ci->sq += q;
+        tq += q;
+        next[i] = -1;
+        if (ci->tail >= 0)
+            next[ci->tail] = i;
+        else
+            ci->head = i;
+        ci->tail = i;
+    }
+
+    for (int l = 0; l < dim; l++)
+        tt += ts[l] * ts[l];
+    double tss = tq - tt / n, wgss = 0;
+    for (int j = 0; j < k; j++)
+    {
+        wgss += cut_wgss(&c[j], dim);
+        cut_scatter(&c[j], obj, next, dim);
+    }
+    for (int j = 0; j < k; j++)
+        cut_worst(c, j, live, k, dim);
+
+    int nlive = k;
+    for (int s = 0; s <= ix->steps; s++)
+    {
+        struct cut_score *sc = &ix->out[ix->steps - s];
+        double total = 0;
+        for (int l = 0; l < nlive; l++)
+            total += c[live[l]].worst;
+
+        // clusters without spread divide by zero, clusters of equal
+        // centroids have infinite ratio, so both indices are undefined
+        sc->n = nlive;
+        sc->ch = wgss > 0 && n > nlive ? ((tss - wgss) / (nlive - 1)) / (wgss / (n - nlive)) : NAN;
+        sc->db = n > nlive && !isinf(total) ? total / nlive : NAN;
+
+        if (s == ix->steps)
+            break;
+
+        int ia = ix->mg[s].a, ib = ix->mg[s].b;
+        struct cut_cluster *a = &c[ia], *b = &c[ib];
+        wgss -= cut_wgss(a, dim) + cut_wgss(b, dim);
+        a->size += b->size;
+        for (int l = 0; l < dim; l++)
+            a->s[l] += b->s[l];
+        a->sq += b->sq;
+        next[a->tail] = b->head;
+        a->tail = b->tail;
+        wgss += cut_wgss(a, dim);
+        cut_scatter(a, obj, next, dim);
+
+        for (int l = 0; l < nlive; l++)
+            if (live[l] == ib)
+            {
+                live[l] = live[--nlive];
+                break;
+            }
+
+        for (int l = 0; l < nlive; l++)
+        {
+            int i = live[l];
+            if (i == ia)
+                continue;
+            if (c[i].partner == ia || c[i].partner == ib)
+                cut_worst(c, i, live, nlive, dim);
+            else
+            {
+                double r = cut_ratio(&c[i], a, dim);
+                if (r > c[i].worst)
+                {
+                    c[i].worst = r;
+                    c[i].partner = ia;
+                }
+            }
+        }
+        cut_worst(c, ia, live, nlive, dim);
+    }
+
+    xfree(c);
+    xfree(cs);
+    xfree(next);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+int score_cuts(const struct dendro *d, const struct obj_t *obj, const float *dist,
+               int lo, int hi, int threads, struct cut_score *out)
+{
+    int n = d->n, k = hi, steps = hi - lo;
+    int *owner = xmalloc(sizeof(int) * 3 * n);
+    struct cut_merge *mg = xmalloc(sizeof(struct cut_merge) * (steps > 0 ? steps : 1));
+    double *sum = xmalloc(sizeof(double) * (steps + 1) * (threads > 0 ? threads : 1));
+    int failed = owner == NULL || mg == NULL || sum == NULL;
+
+    if (threads > n)
+        threads = n;
+    if (threads < 1)
+        threads = 1;
+
+    if (failed)
+    {
+        xfree(owner);
+        xfree(mg);
+        xfree(sum);
+        return -1;
+    }
+
+    int *index = owner + n;
+    int *cl = index + n;
+
+    // first cut as in dendro_cut, clusters numbered in order of position
+    dendro_owners(d, hi, owner);
+
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        index[i] = owner[i] == i ? count++ : -1;
+    for (int i = 0; i < n; i++)
+        cl[i] = index[owner[i]];
+
+    // later merges are of clusters alive in the first cut
+    for (int s = 0; s < steps; s++)
+    {
+        mg[s].a = index[d->merges[n - hi + s].a];
+        mg[s].b = index[d->merges[n - hi + s].b];
+    }
+
+    // Calinski-Harabasz and Davies-Bouldin run in a thread of their own
+    // beside the silhouette workers
+    struct cut_indices ix = { obj, n, k, cl, mg, steps, out, 0 };
+    pthread_t indices;
+    int indices_started = !pthread_create(&indices, NULL, cut_indices_run, &ix);
+
+    pthread_t tid[threads];
+    struct silhouette arg[threads];
+    int started[threads];
+
+    for (int t = 0; t < threads; t++)
+    {
+        arg[t].dist = dist;
+        arg[t].n = n;
+        arg[t].k = k;
+        arg[t].cl = cl;
+        arg[t].mg = mg;
+        arg[t].steps = steps;
+        arg[t].first = (long long)n * t / threads;
+        arg[t].last = (long long)n * (t + 1) / threads;
+        arg[t].sum = sum + (size_t)t * (steps + 1);
+        arg[t].failed = 0;
+        started[t] = t > 0 && !pthread_create(&tid[t], NULL, silhouette_rows, &arg[t]);
+    }
+
+    // this thread takes rows of its own and of threads which didn't start
+    for (int t = 0; t < threads; t++)
+        if (!started[t])
+            silhouette_rows(&arg[t]);
+    if (!indices_started)
+        cut_indices_run(&ix);
+
+    for (int t = 1; t < threads; t++)
+        if (started[t])
+            pthread_join(tid[t], NULL);
+    if (indices_started)
+        pthread_join(indices, NULL);
+
+    for (int s = 0; s <= steps; s++)
+    {
+        double total = 0;
+        for (int t = 0; t < threads; t++)
+            total += arg[t].sum[s];
+        out[hi - s - lo].silhouette = total / n;
+    }
+
+    failed = ix.failed;
+    for (int t = 0; t < threads; t++)
+        failed |= arg[t].failed;
+
+    xfree(owner);
+    xfree(mg);
+    xfree(sum);
+    return failed ? -1 : 0;
+}
+
+/**
+*  Prints score, nan if it is undefined
+*  @ingroup score
+*  @param v score
+*  @param end character printed after score
+*/
+static void print_score(double v, char end)
+{
+    if (isnan(v))
+        printf("nan%c", end);
+    else
+        printf("%.6f%c", v, end);
+}
+
+int score_run(struct cluster_t *carr, int size, int lo, int hi, const struct engine_opts *opts)
+{
+    struct engine_opts o = *opts;
+    struct obj_t *obj = NULL;
+    struct cut_score *sc = NULL;
+    struct dendro d = { 0, 0, NULL };
+    float *dist = NULL;
+    int ok = 1;
+
+    if (lo < 2 || hi > size || lo > hi)
+    {
+        fprintf(stderr, "Invalid range of cuts\n");
+        ok = 0;
+    }
+    else if ((obj = xmalloc(sizeof(struct obj_t) * size)) == NULL)
+        ok = 0;
+
+    for (int i = 0; ok && i < size; i++)
+    {
+        ok = carr[i].size == 1;
+        obj[i] = CLUSTER_OBJ(&carr[i])[0];
+    }
+
+    // one matrix serves the engine and silhouette
+    if (ok && !(dist = distance_matrix(obj, size, opts->threads)))
+        ok = 0;
+
+    uint64_t key = ok ? cache_key(obj, size) : 0;
+    if (ok && !(cache_dir && cache_load(key, obj, size, opts->method, &d)))
+    {
+        o.dendro = &d;
+        o.dist = dist;
+        if ((ok = dendro_init(&d, size)))
+        {
+            int count = engine_run(carr, size, 1, &o);
+            if (!(ok = count >= 0))
+                dendro_free(&d);
+            else
+            {
+                size = count;
+                if (cache_dir && !cache_store(key, obj, opts->method, &d))
+                    fprintf(stderr, "Result can't be stored in cache\n");
+            }
+        }
+    }
+
+    for (int i = 0; i < size; i++)
+        clear_cluster(&carr[i]);
+    xfree(carr);
+
+    if (ok && (sc = xmalloc(sizeof(struct cut_score) * (hi - lo + 1))))
+        ok = !score_cuts(&d, obj, dist, lo, hi, opts->threads, sc);
+    else
+        ok = 0;
+
+    if (ok)
+    {
+        // undefined scores don't take part in the best N
+        int best[3] = { lo, -1, -1 };
+        char name[3][16];
+        printf("N silhouette calinski_harabasz davies_bouldin\n");
+        for (int i = 0; i <= hi - lo; i++)
+        {
+            printf("%d %.6f ", sc[i].n, sc[i].silhouette);
+            print_score(sc[i].ch, ' ');
+            print_score(sc[i].db, '\n');
+            if (sc[i].silhouette > sc[best[0] - lo].silhouette)
+                best[0] = sc[i].n;
+            if (!isnan(sc[i].ch) && (best[1] < 0 || sc[i].ch > sc[best[1] - lo].ch))
+                best[1] = sc[i].n;
+            if (!isnan(sc[i].db) && (best[2] < 0 || sc[i].db < sc[best[2] - lo].db))
+                best[2] = sc[i].n;
+        }
+        for (int j = 0; j < 3; j++)
+            snprintf(name[j], sizeof(name[j]), best[j] < 0 ? "-" : "%d", best[j]);
+        printf("Best N: silhouette %s, calinski_harabasz %s, davies_bouldin %s\n",
+               name[0], name[1], name[2]);
+    }
+    else if (obj)
+        fprintf(stderr, "Cuts can't be scored\n");
+
+    if (d.merges)
+        dendro_free(&d);
+    xfree(sc);
+    xfree(dist);
+    xfree(obj);
+    return ok ? 0 : -1;
+}
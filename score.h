@@ -0,0 +1,67 @@
+/*
+*
+*  @brief     Cut scores
+*  @details   Silhouette, Calinski-Harabasz and Davies-Bouldin index of
+*             every cut of dendrogram in a range of N
+*  @author    Matej Soroka
+*
+*/
+#ifndef SCORE_H
+#define SCORE_H
+
+#include "engine.h"
+
+///@defgroup score Cut scores
+
+/*
+ Consecutive cuts differ by one merge, so scores are updated by that merge
+ instead of being computed again. Silhouette keeps for every object its sum
+ of distances to every cluster of the cut, a merge adds two columns, so one
+ cut costs O(n * N). Objects are split between threads and every thread
+ walks all cuts on its objects without waiting for others.
+ Calinski-Harabasz keeps sums of coordinates and squares of clusters, a
+ merge updates them in O(1). Davies-Bouldin recomputes scatter only of the
+ merged cluster and keeps the highest ratio of every cluster, which is
+ searched again only for the merged cluster and clusters whose highest
+ ratio was to one of the merged ones. Both indices run in one thread beside
+ the silhouette workers. Silhouette uses distances of --metric, both
+ indices are defined by centroids and stay Euclidean.
+*/
+
+/// @struct cut_score
+struct cut_score {
+    int n;              ///< number of clusters of cut
+    double silhouette;  ///< mean silhouette of objects, higher is better
+    double ch;          ///< Calinski-Harabasz index, higher is better
+    double db;          ///< Davies-Bouldin index, lower is better
+};
+
+/**
+*  Computes scores of cuts from hi clusters down to lo clusters
+*  @ingroup score
+*  @param d complete dendrogram
+*  @param obj objects in order of positions
+*  @param dist condensed matrix of obj_distance of all pairs of objects
+*  @param lo lowest number of clusters, at least 2
+*  @param hi highest number of clusters, at most number of objects
+*  @param threads number of threads
+*  @param out array of hi - lo + 1 scores, out[i] is cut of lo + i clusters
+*  @return zero or -1 if memory can't be allocated
+*/
+int score_cuts(const struct dendro *d, const struct obj_t *obj, const float *dist,
+               int lo, int hi, int threads, struct cut_score *out);
+
+/**
+*  Records dendrogram of loaded singletons (from cache if it is used),
+*  prints scores of cuts from lo to hi clusters and best N of every score
+*  @ingroup score
+*  @param carr array of loaded singletons, it is freed
+*  @param size number of clusters in array
+*  @param lo lowest number of clusters
+*  @param hi highest number of clusters
+*  @param opts engine, method and threads
+*  @return zero or -1 on error
+*/
+int score_run(struct cluster_t *carr, int size, int lo, int hi, const struct engine_opts *opts);
+
+#endif
@@ -0,0 +1,910 @@
+/*
+*
+*  @brief     Resident server
+*  @details   Keeps datasets and their dendrograms in memory and answers
+*             requests over Unix socket
+*  @author    Matej Soroka
+*
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "alloc.h"
+#include "server.h"
+#include "cache.h"
+#include "stats.h"
+#include "numa.h"
+
+/// Largest distance matrix kept with dataset in bytes
+#define SERVER_MATRIX_LIMIT ((size_t)256 << 20)
+
+/// Largest number of datasets kept, least recently requested one is
+/// dropped when another file is loaded
+#define SERVER_DATASETS 16
+
+/// Longest request line including newline
+#define SERVER_LINE 4096
+
+/// @struct dataset
+/// Loaded file with everything computed for it, shared by requests
+struct dataset {
+    char path[1024];                     ///< path given in request
+    struct stat st;                      ///< file identity and mtime when loaded
+    pthread_mutex_t lock;                ///< guards loading and dendrograms
+    int loaded;                          ///< nonzero after load was tried
+    struct obj_t *obj;                   ///< objects in order of file
+    int n;                               ///< number of objects, 0 if load failed
+    uint64_t key;                        ///< key of objects in cache
+    float *dist;                         ///< condensed distances of objects or NULL
+    struct dendro dendro[METHOD_COUNT];  ///< dendrogram of every method
+    struct dendro_layout layout[METHOD_COUNT]; ///< leaf order of dendrogram,
+                                         ///< cuts are ranges of it
+    int done[METHOD_COUNT];              ///< nonzero if dendrogram is complete
+    int refs;                            ///< requests using dataset
+    int stale;                           ///< removed from list, freed by last request
+    struct dataset *next;                ///< next dataset in list
+};
+
+/// @struct request
+struct request {
+    int fd;                   ///< socket of client
+    unsigned gen;             ///< generation of client slot
+    char line[SERVER_LINE];   ///< request line
+    char *answer;             ///< answer allocated by open_memstream
+    size_t len;               ///< length of answer
+    struct request *next;     ///< next request in queue
+};
+
+/// @struct client
+struct client {
+    int fd;                   ///< socket or -1 if slot is free
+    unsigned gen;             ///< incremented when slot is closed
+    unsigned events;          ///< events registered in epoll
+    char in[SERVER_LINE];     ///< received bytes
+    size_t inlen;             ///< number of received bytes
+    char *out;                ///< answer being sent or NULL
+    size_t outlen;            ///< length of answer
+    size_t outpos;            ///< bytes of answer already sent
+    int busy;                 ///< request is computed by worker
+    int eof;                  ///< client won't send more requests
+};
+
+/// State of server shared by event loop and workers
+struct server {
+    const struct engine_opts *opts;  ///< engine, default method, threads
+    pthread_mutex_t lock;            ///< guards queues and dataset list
+    pthread_cond_t cond;             ///< signals new request or stop
+    struct request *queue;           ///< requests waiting for worker
+    struct request **queue_tail;     ///< end of queue
+    struct request *done;            ///< answered requests
+    struct dataset *datasets;        ///< loaded datasets
+    int stop;                        ///< workers should exit
+    int wake;                        ///< eventfd waking event loop
+    int epoll;                       ///< epoll of event loop
+    struct client *clients;          ///< clients indexed by socket
+    int nclients;                    ///< size of clients array
+};
+
+/**
+*  Frees dataset and everything computed for it
+*  @ingroup server
+*  @param d dataset
+*/
+static void dataset_free(struct dataset *d)
+{
+    for (int m = 0; m < METHOD_COUNT; m++)
+        if (d->done[m])
+        {
+            dendro_free(&d->dendro[m]);
+            dendro_layout_free(&d->layout[m]);
+        }
+    xfree(d->dist);
+    // coordinates of objects of more dimensions start at the first object
+    if (d->obj)
+        xfree(d->obj[0].v);
+    xfree(d->obj);
+    pthread_mutex_destroy(&d->lock);
+    xfree(d);
+}
+
+/**
+*  Removes dataset from list, it is freed now or by its last request
+*  @ingroup server
+*  @param p link to dataset in list, locked by caller
+*/
+static void dataset_unlink(struct dataset **p)
+{
+    struct dataset *d = *p;
+
+    *p = d->next;
+    d->stale = 1;
+    if (d->refs == 0)
+        dataset_free(d);
+}
+
+/**
+*  Finds dataset of file or adds empty one. Dataset of changed file is
+*  replaced. List is kept in order of last request, datasets over
+*  SERVER_DATASETS are dropped from its end.
+*  @ingroup server
+*  @param s server
+*  @param path path of file
+*  @param st current stat of file
+*  @return referenced dataset or NULL if memory can't be allocated
+*/
+static struct dataset *dataset_get(struct server *s, const char *path, const struct stat *st)
+{
+    struct dataset **p, *d;
+
+    pthread_mutex_lock(&s->lock);
+    for (p = &s->datasets; (d = *p); p = &d->next)
+    {
+        if (strcmp(d->path, path))
+            continue;
+
+        if (d->st.st_dev == st->st_dev && d->st.st_ino == st->st_ino &&
+            d->st.st_size == st->st_size &&
+            d->st.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+            d->st.st_mtim.tv_nsec == st->st_mtim.tv_nsec)
+        {
+            d->refs++;
+            *p = d->next;
+            d->next = s->datasets;
+            s->datasets = d;
+            pthread_mutex_unlock(&s->lock);
+            return d;
+        }
+
+        // file changed, running requests keep the old dataset
+        dataset_unlink(p);
+        break;
+    }
+
+    if ((d = xmalloc(sizeof(*d))))
+    {
+        memset(d, 0, sizeof(*d));
+        snprintf(d->path, sizeof(d->path), "%s", path);
+        d->st = *st;
+        d->refs = 1;
+        pthread_mutex_init(&d->lock, NULL);
+        d->next = s->datasets;
+        s->datasets = d;
+
+        int count = 0;
+        for (p = &s->datasets; *p; )
+            if (++count > SERVER_DATASETS)
+                dataset_unlink(p);
+            else
+                p = &(*p)->next;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return d;
+}
+
+/**
+*  Releases reference of request to dataset
+*  @ingroup server
+*  @param s server
+*  @param d dataset
+*/
+static void dataset_put(struct server *s, struct dataset *d)
+{
+    pthread_mutex_lock(&s->lock);
+    if (--d->refs == 0 && d->stale)
+        dataset_free(d);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+*  Removes dataset from list, so next request tries to load it again
+*  @ingroup server
+*  @param s server
+*  @param d referenced dataset
+*/
+static void dataset_drop(struct server *s, struct dataset *d)
+{
+    pthread_mutex_lock(&s->lock);
+    for (struct dataset **p = &s->datasets; *p; p = &(*p)->next)
+        if (*p == d)
+        {
+            *p = d->next;
+            d->stale = 1;
+            break;
+        }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+*  Loads objects of dataset
+*  @ingroup server
+*  @param d dataset locked by caller
+*/
+static void dataset_load(struct dataset *d)
+{
+    struct cluster_t *carr;
+    int size = load_clusters(d->path, &carr);
+
+    d->loaded = 1;
+    if (size == 0)
+        return;
+
+    float *coords = CLUSTER_OBJ(&carr[0])[0].v;
+    if ((d->obj = xmalloc(sizeof(struct obj_t) * size)))
+        d->n = size;
+    else
+        xfree(coords);
+    for (int i = 0; i < size; i++)
+    {
+        if (d->obj)
+            d->obj[i] = CLUSTER_OBJ(&carr[i])[0];
+        clear_cluster(&carr[i]);
+    }
+    xfree(carr);
+
+    if (d->obj)
+        d->key = cache_key(d->obj, d->n);
+}
+
+/**
+*  Runs engine down to one cluster and records dendrogram of method
+*  @ingroup server
+*  @param d loaded dataset locked by caller
+*  @param method cluster distance method
+*  @param base engine and threads
+*  @return nonzero if dendrogram was computed
+*/
+static int dataset_run(struct dataset *d, int method, const struct engine_opts *base)
+{
+    struct engine_opts opts = *base;
+
+    if (cache_dir && cache_load(d->key, d->obj, d->n, method, &d->dendro[method]))
+        return 1;
+
+    struct cluster_t *carr = xmalloc(sizeof(struct cluster_t) * d->n);
+    int ok = carr != NULL;
+
+    // singleton distances are the same for every method, matrix engine
+    // copies them instead of computing them again. It merges like ref, so
+    // it also answers methods which would run ref.
+    int fits = (size_t)d->n * (d->n - 1) / 2 * sizeof(float) <= SERVER_MATRIX_LIMIT;
+    opts.method = method;
+    opts.engine = engine_for_method(opts.engine, method);
+    if (fits && opts.engine == ENGINE_REF)
+        opts.engine = ENGINE_MATRIX;
+    if (ok && fits && opts.engine == ENGINE_MATRIX && d->dist == NULL)
+        d->dist = distance_matrix(d->obj, d->n, opts.threads);
+
+    opts.ws = NULL;
+    opts.dendro = &d->dendro[method];
+    opts.dist = d->dist;
+
+    for (int i = 0; ok && i < d->n; i++)
+    {
+        init_cluster(&carr[i], 1);
+        append_cluster(&carr[i], d->obj[i]);
+    }
+
+    if (ok && (ok = dendro_init(opts.dendro, d->n)))
+    {
+        int size = engine_run(carr, d->n, 1, &opts);
+        if ((ok = size >= 0))
+            for (int i = 0; i < size; i++)
+                clear_cluster(&carr[i]);
+        else
+            dendro_free(opts.dendro);
+    }
+
+    if (ok && cache_dir && !cache_store(d->key, d->obj, method, opts.dendro))
+        fprintf(stderr, "Result can't be stored in cache\n");
+
+    xfree(carr);
+    return ok;
+}
+
+/**
+*  Records dendrogram of method and orders objects by it, so every request
+*  cuts ranges of objects
+*  @ingroup server
+*  @param d loaded dataset locked by caller
+*  @param method cluster distance method
+*  @param base engine and threads
+*  @return nonzero if dendrogram was computed
+*/
+static int dataset_dendro(struct dataset *d, int method, const struct engine_opts *base)
+{
+    if (!dataset_run(d, method, base))
+        return 0;
+
+    if (!dendro_layout_init(&d->layout[method], &d->dendro[method], d->obj))
+    {
+        dendro_free(&d->dendro[method]);
+        return 0;
+    }
+    return d->done[method] = 1;
+}
+
+/**
+*  Formats error answer
+*  @ingroup server
+*  @param msg message
+*  @param len pointer for length of answer
+*  @return answer or NULL if memory can't be allocated
+*/
+static char *answer_error(const char *msg, size_t *len)
+{
+    char *buf = NULL;
+    FILE *f = open_memstream(&buf, len);
+
+    if (f == NULL)
+        return NULL;
+    fprintf(f, "ERROR %s\n\n", msg);
+    fclose(f);
+    return buf;
+}
+
+/**
+*  Computes answer of request
+*  @ingroup server
+*  @param s server
+*  @param line request line
+*  @param len pointer for length of answer
+*  @return answer or NULL if memory can't be allocated
+*/
+static char *answer(struct server *s, const char *line, size_t *len)
+{
+    char file[1024], n[32], m[32] = "", extra[2];
+    char *fail;
+    struct stat st;
+    int method = s->opts->method;
+
+    int fields = sscanf(line, "%1023s %31s %31s %1s", file, n, m, extra);
+    if (fields < 2 || fields > 3)
+        return answer_error("invalid request", len);
+
+    int narr = strtol(n, &fail, 10);
+    if (*fail || narr <= 0)
+        return answer_error("invalid cluster count", len);
+
+    if (m[0])
+    {
+        if (m[0] != '-' || m[1] != '-' || (method = method_by_name(m + 2)) < 0)
+            return answer_error("invalid method", len);
+    }
+
+    if (stat(file, &st))
+        return answer_error("dataset not found", len);
+
+    struct dataset *d = dataset_get(s, file, &st);
+    if (d == NULL)
+        return answer_error("memory allocation failed", len);
+
+    const char *error = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (!d->loaded)
+        dataset_load(d);
+    if (d->n == 0)
+        error = "load failed";
+    else if (narr > d->n)
+        error = "N is greater than count of clusters";
+    else
+        error = engine_unsupported(&d->obj[0], method);
+    if (error == NULL && !d->done[method] && !dataset_dendro(d, method, s->opts))
+        error = "memory allocation failed";
+    pthread_mutex_unlock(&d->lock);
+
+    // dendrogram and objects don't change once computed, cut runs unlocked
+    struct cluster_t *carr = NULL;
+    int count = -1;
+    if (error == NULL && (count = dendro_layout_cut(&d->layout[method], narr, &carr)) < 0)
+        error = "memory allocation failed";
+
+    if (d->n == 0)
+        dataset_drop(s, d);
+    dataset_put(s, d);
+
+    if (error)
+        return answer_error(error, len);
+
+    char *buf = NULL;
+    FILE *f = open_memstream(&buf, len);
+    if (f)
+    {
+        fprint_clusters(f, carr, count);
+        putc('\n', f);
+        fclose(f);
+    }
+
+    for (int i = 0; i < count; i++)
+        clear_cluster(&carr[i]);
+    xfree(carr);
+    return buf;
+}
+
+/**
+*  Worker computing answers of queued requests
+*  @ingroup server
+*  @param arg pointer to struct server
+*  @return NULL
+*/
+static void *server_worker(void *arg)
+{
+    struct server *s = arg;
+    uint64_t one = 1;
+    int pinned = numa_pin();
+
+    pthread_mutex_lock(&s->lock);
+    for (;;)
+    {
+        while (s->queue == NULL && !s->stop)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->stop)
+            break;
+
+        struct request *r = s->queue;
+        if ((s->queue = r->next) == NULL)
+            s->queue_tail = &s->queue;
+        pthread_mutex_unlock(&s->lock);
+
+        double t = stats_now();
+        r->answer = answer(s, r->line, &r->len);
+        const char *status = r->answer == NULL ? "no memory" :
+                             strncmp(r->answer, "ERROR", 5) ? "ok" : r->answer + 6;
+        fprintf(stderr, "request: %s: %.*s, %.6f s\n", r->line,
+                (int)strcspn(status, "\n"), status, stats_now() - t);
+
+        pthread_mutex_lock(&s->lock);
+        r->next = s->done;
+        s->done = r;
+        if (write(s->wake, &one, sizeof(one)) < 0)
+            perror("eventfd");
+    }
+    pthread_mutex_unlock(&s->lock);
+    numa_unpin(pinned);
+    return NULL;
+}
+
+/**
+*  Closes connection of client, answer of its running request is dropped
+*  @ingroup server
+*  @param c client
+*/
+static void client_close(struct client *c)
+{
+    close(c->fd);
+    free(c->out);
+    c->out = NULL;
+    c->fd = -1;
+    c->gen++;
+}
+
+/**
+*  Registers events client waits for
+*  @ingroup server
+*  @param s server
+*  @param c client
+*/
+static void client_watch(struct server *s, struct client *c)
+{
+    struct epoll_event ev;
+
+    ev.events = (c->eof || c->inlen == SERVER_LINE ? 0 : EPOLLIN) | (c->out ? EPOLLOUT : 0);
+    ev.data.fd = c->fd;
+    if (ev.events != c->events)
+    {
+        epoll_ctl(s->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = ev.events;
+    }
+}
+
+/**
+*  Sends answer, queues next request of client or closes finished client
+*  @ingroup server
+*  @param s server
+*  @param c client
+*/
+static void client_next(struct server *s, struct client *c)
+{
+    while (c->out)
+    {
+        ssize_t w = send(c->fd, c->out + c->outpos, c->outlen - c->outpos, MSG_NOSIGNAL);
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (w < 0)
+        {
+            client_close(c);
+            return;
+        }
+        if ((c->outpos += w) == c->outlen)
+        {
+            free(c->out);
+            c->out = NULL;
+        }
+    }
+
+    // one request of client is computed at a time, answers keep order
+    char *nl;
+    if (!c->busy && !c->out && (nl = memchr(c->in, '\n', c->inlen)))
+    {
+        struct request *r = xmalloc(sizeof(*r));
+        if (r == NULL)
+        {
+            client_close(c);
+            return;
+        }
+
+        size_t n = nl - c->in;
+        memcpy(r->line, c->in, n);
+        r->line[n - (n > 0 && r->line[n - 1] == '\r')] = '\0';
+        memmove(c->in, nl + 1, c->inlen - n - 1);
+        c->inlen -= n + 1;
+
+        r->fd = c->fd;
+        r->gen = c->gen;
+        r->next = NULL;
+        c->busy = 1;
+
+        pthread_mutex_lock(&s->lock);
+        *s->queue_tail = r;
+        s->queue_tail = &r->next;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    if (!c->busy && !c->out && (c->eof || c->inlen == SERVER_LINE))
+        client_close(c);
+    else
+        client_watch(s, c);
+}
+
+/**
+*  Accepts waiting connections
+*  @ingroup server
+*  @param s server
+*  @param listener listening socket
+*/
+static void server_accept(struct server *s, int listener)
+{
+    int fd;
+
+    while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        if (fd >= s->nclients)
+        {
+            int n = s->nclients ? s->nclients : 64;
+            while (n <= fd)
+                n *= 2;
+            struct client *tmp = xrealloc(s->clients, sizeof(struct client) * n);
+            if (tmp == NULL)
+            {
+                close(fd);
+                continue;
+            }
+            for (int i = s->nclients; i < n; i++)
+            {
+                tmp[i].fd = -1;
+                tmp[i].gen = 0;
+            }
+            s->clients = tmp;
+            s->nclients = n;
+        }
+
+        struct client *c = &s->clients[fd];
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        c->fd = fd;
+        c->events = EPOLLIN;
+        c->inlen = c->outlen = c->outpos = 0;
+        c->out = NULL;
+        c->busy = c->eof = 0;
+        if (epoll_ctl(s->epoll, EPOLL_CTL_ADD, fd, &ev))
+            client_close(c);
+    }
+}
+
+/**
+*  Reads available bytes of client
+*  @ingroup server
+*  @param s server
+*  @param c client
+*/
+static void client_read(struct server *s, struct client *c)
+{
+    while (c->inlen < SERVER_LINE)
+    {
+        ssize_t r = read(c->fd, c->in + c->inlen, SERVER_LINE - c->inlen);
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (r <= 0)
+        {
+            c->eof = 1;
+            break;
+        }
+        c->inlen += r;
+    }
+    client_next(s, c);
+}
+
+/**
+*  Hands answers of workers to their clients
+*  @ingroup server
+*  @param s server
+*/
+static void server_answers(struct server *s)
+{
+    uint64_t count;
+
+    if (read(s->wake, &count, sizeof(count)) < 0)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    struct request *r = s->done;
+    s->done = NULL;
+    pthread_mutex_unlock(&s->lock);
+
+    while (r)
+    {
+        struct request *next = r->next;
+        struct client *c = &s->clients[r->fd];
+
+        if (c->fd == r->fd && c->gen == r->gen)
+        {
+            c->busy = 0;
+            if (r->answer == NULL)
+                client_close(c);
+            else
+            {
+                c->out = r->answer;
+                c->outlen = r->len;
+                c->outpos = 0;
+                client_next(s, c);
+            }
+        }
+        else
+            free(r->answer);
+
+        xfree(r);
+        r = next;
+    }
+}
+
+/**
+*  Creates listening socket, socket file left by dead server is replaced
+*  @ingroup server
+*  @param path path of socket
+*  @return socket or -1
+*/
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int bound = !bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (!bound && errno == EADDRINUSE)
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            fprintf(stderr, "Server is already running on %s\n", path);
+            close(probe);
+            close(fd);
+            return -1;
+        }
+        if (probe >= 0)
+            close(probe);
+        unlink(path);
+        bound = !bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    if (!bound || listen(fd, 64))
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve(const char *path, int workers, const struct engine_opts *opts)
+{
+    struct server s;
+    sigset_t mask;
+    int listener, sig;
+
+    memset(&s, 0, sizeof(s));
+    s.opts = opts;
+    s.queue_tail = &s.queue;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+
+    // signals are read from signalfd, workers inherit the blocked mask
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    if ((listener = server_listen(path)) < 0)
+        return -1;
+
+    s.epoll = epoll_create1(EPOLL_CLOEXEC);
+    s.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sig = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    struct epoll_event ev = { .events = EPOLLIN };
+    int failed = s.epoll < 0 || s.wake < 0 || sig < 0;
+    ev.data.fd = listener;
+    failed = failed || epoll_ctl(s.epoll, EPOLL_CTL_ADD, listener, &ev);
+    ev.data.fd = s.wake;
+    failed = failed || epoll_ctl(s.epoll, EPOLL_CTL_ADD, s.wake, &ev);
+    ev.data.fd = sig;
+    failed = failed || epoll_ctl(s.epoll, EPOLL_CTL_ADD, sig, &ev);
+
+    pthread_t tid[workers];
+    int started = 0;
+    while (!failed && started < workers &&
+           !pthread_create(&tid[started], NULL, server_worker, &s))
+        started++;
+
+    if (failed || started == 0)
+    {
+        fprintf(stderr, "Server can't be started\n");
+        failed = 1;
+    }
+    else
+        fprintf(stderr, "server: listening on %s, %d workers\n", path, started);
+
+    while (!failed)
+    {
+        struct epoll_event events[64];
+        int n = epoll_wait(s.epoll, events, 64, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+
+        int stop = 0;
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+                server_accept(&s, listener);
+            else if (fd == s.wake)
+                server_answers(&s);
+            else if (fd == sig)
+                stop = 1;
+            else if (fd < s.nclients && s.clients[fd].fd == fd)
+            {
+                struct client *c = &s.clients[fd];
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    client_close(c);
+                else if (events[i].events & EPOLLIN)
+                    client_read(&s, c);
+                else
+                    client_next(&s, c);
+            }
+        }
+        if (stop)
+            break;
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.stop = 1;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+    for (int t = 0; t < started; t++)
+        pthread_join(tid[t], NULL);
+
+    for (struct request *r = s.queue, *next; r; r = next)
+    {
+        next = r->next;
+        xfree(r);
+    }
+    for (struct request *r = s.done, *next; r; r = next)
+    {
+        next = r->next;
+        free(r->answer);
+        xfree(r);
+    }
+    for (int i = 0; i < s.nclients; i++)
+        if (s.clients[i].fd >= 0)
+            client_close(&s.clients[i]);
+    xfree(s.clients);
+    for (struct dataset *d = s.datasets, *next; d; d = next)
+    {
+        next = d->next;
+        dataset_free(d);
+    }
+
+    if (sig >= 0)
+        close(sig);
+    if (s.wake >= 0)
+        close(s.wake);
+    if (s.epoll >= 0)
+        close(s.epoll);
+    close(listener);
+    unlink(path);
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    return failed ? -1 : 0;
+}
+
+int serve_request(const char *path, const char *request)
+{
+    struct sockaddr_un addr;
+    char buf[65536];
+    char last[2] = "";
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int first = 1, error = 0;
+    ssize_t r;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t len = strlen(request);
+    if (send(fd, request, len, MSG_NOSIGNAL) != (ssize_t)len ||
+        send(fd, "\n", 1, MSG_NOSIGNAL) != 1)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // answer ends with empty line, which is not printed; the newline held
+    // back in last is printed only if more of the answer follows
+    while ((r = read(fd, buf, sizeof(buf))) > 0)
+    {
+        if (first)
+            error = r >= 5 && !strncmp(buf, "ERROR", 5);
+        first = 0;
+        FILE *out = error ? stderr : stdout;
+
+        fputs(last, out);
+        fwrite(buf, 1, r - 1, out);
+        last[0] = buf[r - 1];
+    }
+    close(fd);
+
+    if (r < 0 || first)
+    {
+        fprintf(stderr, "Server closed connection without answer\n");
+        return -1;
+    }
+    return error ? -1 : 0;
+}
@@ -0,0 +1,51 @@
+/*
+*
+*  @brief     Resident server
+*  @details   Keeps datasets and their dendrograms in memory and answers
+*             requests over Unix socket
+*  @author    Matej Soroka
+*
+*/
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "engine.h"
+
+///@defgroup server Resident server
+
+/*
+ Protocol is line based. Client sends "FILE N [METHOD]", METHOD is any
+ method of method_by_name, --avg, --min, --max, --ward, --centroid or
+ --median (default of server). Server answers with output of
+ print_clusters for the request, or with one line "ERROR message", and ends
+ every answer with an empty line. Client may send more requests over one
+ connection, answers come in order of requests. Any file readable by the
+ server can be requested, access to the socket must be restricted by its
+ permissions.
+*/
+
+/**
+*  Runs server on Unix socket until SIGINT or SIGTERM. First request for a
+*  dataset loads it and runs engine down to one cluster, every other N of
+*  the same dataset and method is cut from the recorded dendrogram. Methods
+*  which would run ref run the matrix engine when distances of the dataset
+*  fit into SERVER_MATRIX_LIMIT, singleton distances are kept with dataset
+*  and shared by these methods.
+*  @ingroup server
+*  @param path path of socket
+*  @param workers number of threads computing answers
+*  @param opts engine, default method and threads of engine runs
+*  @return zero if server was stopped by signal, -1 on error
+*/
+int serve(const char *path, int workers, const struct engine_opts *opts);
+
+/**
+*  Sends one request to server and prints answer to stdout
+*  @ingroup server
+*  @param path path of socket
+*  @param request request line without newline
+*  @return zero if server answered with clusters, -1 otherwise
+*/
+int serve_request(const char *path, const char *request);
+
+#endif
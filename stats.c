@@ -0,0 +1,111 @@
+/*
+*
+*  @brief     Run statistics
+*  @details   Per-phase timers and operation counters for --stats
+*  @author    Matej Soroka
+*
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+#include "perf.h"
+#include "alloc.h"
+
+struct stats stats;
+
+const char *const phase_names[PHASE_COUNT] = {
+    "load", "build", "neighbours", "merge", "remove", "print"
+};
+
+double stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_phase_begin(enum phase p)
+{
+    stats.start[p] = stats_now();
+    if (stats.perf)
+        perf_phase_begin(p);
+}
+
+void stats_phase_end(enum phase p)
+{
+    if (stats.perf)
+        perf_phase_end(p);
+    stats.time[p] += stats_now() - stats.start[p];
+}
+
+/**
+*  Peak resident set size of process
+*  @ingroup stats
+*  @return peak RSS in kilobytes
+*/
+static long peak_rss(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru))
+        return 0;
+    return ru.ru_maxrss;
+}
+
+void stats_report(void)
+{
+    if (stats.json)
+    {
+        fprintf(stderr, "{\n  \"time\": {\n");
+        for (int i = 0; i < PHASE_COUNT; i++)
+            fprintf(stderr, "    \"%s\": %.9f%s\n", phase_names[i], stats.time[i],
+                    i + 1 < PHASE_COUNT ? "," : "");
+        fprintf(stderr, "  },\n");
+        fprintf(stderr, "  \"obj_distance\": %llu,\n", stats.obj_distance);
+        fprintf(stderr, "  \"cluster_distance\": %llu,\n", stats.cluster_distance);
+        fprintf(stderr, "  \"malloc\": %llu,\n", stats.mallocs);
+        fprintf(stderr, "  \"realloc\": %llu,\n", stats.reallocs);
+        fprintf(stderr, "  \"merge_bytes\": %llu,\n", stats.merge_bytes);
+        fprintf(stderr, "  \"remove_bytes\": %llu,\n", stats.remove_bytes);
+#ifdef TRACK_ALLOC
+        fprintf(stderr, "  \"alloc\": {\n");
+        fprintf(stderr, "    \"malloc\": %llu,\n", alloc_stats.mallocs);
+        fprintf(stderr, "    \"realloc\": %llu,\n", alloc_stats.reallocs);
+        fprintf(stderr, "    \"free\": %llu,\n", alloc_stats.frees);
+        fprintf(stderr, "    \"bytes\": %llu,\n", alloc_stats.bytes);
+        fprintf(stderr, "    \"peak_bytes\": %llu,\n", alloc_stats.peak);
+        fprintf(stderr, "    \"realloc_log2_sizes\": [");
+        for (int i = 0; i < ALLOC_BUCKETS; i++)
+            fprintf(stderr, "%s%llu", i ? "," : "", alloc_stats.realloc_size[i]);
+        fprintf(stderr, "]\n  },\n");
+#endif
+        fprintf(stderr, "  \"peak_rss_kb\": %ld\n}\n", peak_rss());
+        return;
+    }
+
+    fprintf(stderr, "Stats:\n");
+    for (int i = 0; i < PHASE_COUNT; i++)
+        fprintf(stderr, "time %-16s %12.6f s\n", phase_names[i], stats.time[i]);
+    fprintf(stderr, "obj_distance     %16llu\n", stats.obj_distance);
+    fprintf(stderr, "cluster_distance %16llu\n", stats.cluster_distance);
+    fprintf(stderr, "malloc           %16llu\n", stats.mallocs);
+    fprintf(stderr, "realloc          %16llu\n", stats.reallocs);
+    fprintf(stderr, "merge bytes      %16llu\n", stats.merge_bytes);
+    fprintf(stderr, "remove bytes     %16llu\n", stats.remove_bytes);
+    fprintf(stderr, "peak RSS         %13ld kB\n", peak_rss());
+#ifdef TRACK_ALLOC
+    fprintf(stderr, "alloc malloc     %16llu\n", alloc_stats.mallocs);
+    fprintf(stderr, "alloc realloc    %16llu\n", alloc_stats.reallocs);
+    fprintf(stderr, "alloc free       %16llu\n", alloc_stats.frees);
+    fprintf(stderr, "alloc bytes      %16llu\n", alloc_stats.bytes);
+    fprintf(stderr, "alloc peak       %16llu\n", alloc_stats.peak);
+    fprintf(stderr, "realloc sizes    ");
+    for (int i = 0; i < ALLOC_BUCKETS; i++)
+        if (alloc_stats.realloc_size[i])
+            fprintf(stderr, " 2^%d:%llu", i, alloc_stats.realloc_size[i]);
+    fprintf(stderr, "\n");
+#endif
+}
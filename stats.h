@@ -0,0 +1,82 @@
+/*
+*
+*  @brief     Run statistics
+*  @details   Per-phase timers and operation counters for --stats
+*  @author    Matej Soroka
+*
+*/
+#ifndef STATS_H
+#define STATS_H
+
+///@defgroup stats Run statistics
+
+/// Phases of the clustering which are timed separately
+enum phase {
+    PHASE_LOAD,       ///< load_clusters
+    PHASE_BUILD,      ///< distance structures of engine
+    PHASE_NEIGHBOURS, ///< find_neighbours
+    PHASE_MERGE,      ///< merge_clusters
+    PHASE_REMOVE,     ///< remove_cluster
+    PHASE_PRINT,      ///< print_clusters
+    PHASE_COUNT
+};
+
+/// @struct stats
+struct stats {
+    int enabled;                          ///< nonzero when --stats is set
+    int perf;                             ///< nonzero when --perf is set
+    int timing;                           ///< nonzero when phases are hooked
+    int json;                             ///< report as JSON
+    double time[PHASE_COUNT];             ///< seconds spent in phase
+    double start[PHASE_COUNT];            ///< start of running phase
+    unsigned long long obj_distance;      ///< obj_distance evaluations
+    unsigned long long cluster_distance;  ///< cluster_distance calls
+    unsigned long long mallocs;           ///< allocations of object arrays
+    unsigned long long reallocs;          ///< reallocations of object arrays
+    unsigned long long merge_bytes;       ///< bytes copied by merge_clusters
+    unsigned long long remove_bytes;      ///< bytes copied by remove_cluster
+};
+
+/// Statistics of current run
+extern struct stats stats;
+
+/// Names of phases used in reports
+extern const char *const phase_names[PHASE_COUNT];
+
+/// adds n to counter, the check keeps counters free when --stats is off
+#define stats_add(counter, n) do { if (stats.enabled) stats.counter += (n); } while (0)
+
+/// starts timer of phase
+#define stats_begin(p) do { if (stats.timing) stats_phase_begin(p); } while (0)
+
+/// stops timer of phase
+#define stats_end(p) do { if (stats.timing) stats_phase_end(p); } while (0)
+
+/**
+*  Current time of monotonic clock
+*  @ingroup stats
+*  @return time in seconds
+*/
+double stats_now(void);
+
+/**
+*  Saves start time of phase and samples hardware counters with --perf
+*  @ingroup stats
+*  @param p phase
+*/
+void stats_phase_begin(enum phase p);
+
+/**
+*  Adds time elapsed since stats_phase_begin to phase
+*  @ingroup stats
+*  @param p phase
+*/
+void stats_phase_end(enum phase p);
+
+/**
+*  Prints collected statistics and peak RSS to stderr
+*  @ingroup stats
+*/
+void stats_report(void);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+*
+*  @brief     Timeline trace
+*  @details   Chrome Trace Event JSON export for --trace
+*  @author    Matej Soroka
+*
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "stats.h"
+#include "trace.h"
+
+int tracing;
+
+/// Trace file
+static FILE *trace_file;
+
+/// Time of trace_open, timestamps are relative to it
+static double trace_origin;
+
+/// Only every trace_stride-th iteration is written
+static long trace_stride = 1;
+
+/// Sum of durations of iterations seen by trace_keep
+static double trace_total;
+
+/// Number of iterations seen by trace_keep
+static long trace_count;
+
+int trace_open(const char *filename)
+{
+    if (!(trace_file = fopen(filename, "w")))
+    {
+        fprintf(stderr, "Trace file can't be opened\n");
+        return 0;
+    }
+
+    trace_origin = stats_now();
+    tracing = 1;
+    fprintf(trace_file, "[\n");
+    return 1;
+}
+
+void trace_iterations(long iterations)
+{
+    trace_stride = iterations / TRACE_ITERATIONS + 1;
+}
+
+int trace_keep(long iter, double dur)
+{
+    double mean = trace_count ? trace_total / trace_count : dur;
+
+    trace_total += dur;
+    trace_count++;
+
+    return iter % trace_stride == 0 || dur > 4 * mean;
+}
+
+void trace_span(const char *name, const char *cat, double start, double end, const char *args)
+{
+    // single fprintf per event, stdio locks the stream for the call
+    fprintf(trace_file,
+            "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%ld,\"args\":%s},\n",
+            name, cat, (start - trace_origin) * 1e6, (end - start) * 1e6,
+            (int)getpid(), (long)syscall(SYS_gettid), args ? args : "{}");
+}
+
+void trace_close(void)
+{
+    // metadata event closes the array, so every span can end with comma
+    fprintf(trace_file,
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"proj3\"}}\n]\n",
+            (int)getpid());
+    fclose(trace_file);
+    trace_file = NULL;
+    tracing = 0;
+}
@@ -0,0 +1,62 @@
+/*
+*
+*  @brief     Timeline trace
+*  @details   Chrome Trace Event JSON export for --trace
+*  @author    Matej Soroka
+*
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+///@defgroup trace Timeline trace
+
+/// Approximate number of merge iterations written to trace
+#define TRACE_ITERATIONS 5000
+
+/// Nonzero when --trace is set
+extern int tracing;
+
+/**
+*  Opens trace file and writes header of event array
+*  @ingroup trace
+*  @param filename name of trace file
+*  @return nonzero if file was opened
+*/
+int trace_open(const char *filename);
+
+/**
+*  Sets how many merge iterations are traced
+*  @ingroup trace
+*  @param iterations number of iterations of run
+*/
+void trace_iterations(long iterations);
+
+/**
+*  Decides whether merge iteration is written. Every k-th iteration is kept
+*  so the file stays small, iterations much slower than average are kept
+*  always so stragglers are visible.
+*  @ingroup trace
+*  @param iter number of iteration
+*  @param dur duration of iteration in seconds
+*  @return nonzero if iteration should be written
+*/
+int trace_keep(long iter, double dur);
+
+/**
+*  Writes complete event, safe to call from several threads
+*  @ingroup trace
+*  @param name name of span
+*  @param cat category of span
+*  @param start start time from stats_now
+*  @param end end time from stats_now
+*  @param args JSON object with arguments of span or NULL
+*/
+void trace_span(const char *name, const char *cat, double start, double end, const char *args);
+
+/**
+*  Finishes event array and closes trace file
+*  @ingroup trace
+*/
+void trace_close(void);
+
+#endif